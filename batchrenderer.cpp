@@ -0,0 +1,105 @@
+#include "batchrenderer.h"
+#include "profiler.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <QDebug>
+
+#include <algorithm>
+
+namespace Glube {
+
+const std::size_t MIN_INDEX_QUADS = 16 * 1024;
+
+BatchRenderer::BatchRenderer(GLBufferArena &arena_):
+    arena(arena_),
+    vao(),
+    commandBuffer(0),
+    offsetBuffer(0),
+    indexBuffer(0),
+    indexQuads(0),
+    multiDraw(-1)
+{
+}
+
+BatchRenderer::~BatchRenderer()
+{
+    if(commandBuffer && glIsBuffer(commandBuffer)) glDeleteBuffers(1, &commandBuffer);
+    if(offsetBuffer && glIsBuffer(offsetBuffer)) glDeleteBuffers(1, &offsetBuffer);
+    if(indexBuffer && glIsBuffer(indexBuffer)) glDeleteBuffers(1, &indexBuffer);
+}
+
+void BatchRenderer::submit(const DrawBatch &batch, GLuint vertexAttrib, GLuint offsetAttrib)
+{
+    const std::vector<DrawBatch::Command> &commands = batch.getCommands();
+    const std::vector<glm::vec3> &offsets = batch.getOffsets();
+    if(commands.empty()) return;
+
+    if(multiDraw < 0) {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        multiDraw = major > 4 || (major == 4 && minor >= 3);
+        qDebug() << "OpenGL" << major << "." << minor << (multiDraw ? ": drawing chunks with multi-draw indirect" : ": drawing chunks one by one");
+
+        vao.allocate();
+        glEnableVertexAttribArray(vertexAttrib);
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        if(multiDraw) {
+            glGenBuffers(1, &commandBuffer);
+            glGenBuffers(1, &offsetBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, offsetBuffer);
+            glEnableVertexAttribArray(offsetAttrib);
+            glVertexAttribPointer(offsetAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+            glVertexAttribDivisor(offsetAttrib, 1);
+        }
+    } else {
+        vao.bind();
+    }
+
+    // the arena replaces its buffer when it grows, so the attribute is pointed at it each time
+    glBindBuffer(GL_ARRAY_BUFFER, arena.buffer());
+    glVertexAttribPointer(vertexAttrib, 4, GL_UNSIGNED_BYTE, GL_FALSE, arena.elementSize(), (void*)0);
+    reserveIndices(batch.getMaxQuads());
+    Profiler::instance().count("draw calls", multiDraw ? 1 : commands.size());
+    Profiler::instance().count("quads drawn", batch.getTotalQuads());
+
+    if(multiDraw) {
+        // orphaned and refilled every frame
+        glBindBuffer(GL_ARRAY_BUFFER, offsetBuffer);
+        glBufferData(GL_ARRAY_BUFFER, offsets.size() * sizeof(glm::vec3), &offsets[0], GL_STREAM_DRAW);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawBatch::Command), &commands[0], GL_STREAM_DRAW);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, commands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        for(std::size_t i = 0; i < commands.size(); ++i) {
+            glVertexAttrib3fv(offsetAttrib, glm::value_ptr(offsets[i]));
+            glDrawElementsBaseVertex(GL_TRIANGLES, commands[i].count, GL_UNSIGNED_INT, (void*)0, commands[i].baseVertex);
+        }
+    }
+
+    glBindVertexArray(0);
+}
+
+void BatchRenderer::reserveIndices(std::size_t quads)
+{
+    if(quads <= indexQuads) return;
+    indexQuads = std::max(std::max(quads, indexQuads * 2), MIN_INDEX_QUADS);
+
+    std::vector<GLuint> indices(indexQuads * 6);
+    for(std::size_t q = 0; q < indexQuads; ++q) {
+        const GLuint v = q * 4;
+        GLuint *i = &indices[q * 6];
+        i[0] = v; i[1] = v + 1; i[2] = v + 2;
+        i[3] = v; i[4] = v + 2; i[5] = v + 3;
+    }
+    // the vertex array is bound, and keeps this buffer as its element array
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    qDebug() << "Quad index buffer grown to" << indexQuads << "quads";
+}
+
+}
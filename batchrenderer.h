@@ -0,0 +1,38 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include "glbufferarena.h"
+#include "drawbatch.h"
+#include "vao.h"
+
+namespace Glube {
+
+// Draws a DrawBatch from a GLBufferArena as indexed triangles. One static index
+// buffer of (0 1 2, 0 2 3) + 4n, shared by every draw, turns the quads into
+// triangles. The offsets are an attribute with divisor 1, picked per draw by its
+// base instance. With GL 4.3 everything goes out in a single
+// glMultiDrawElementsIndirect; otherwise each draw is a glDrawElementsBaseVertex
+// with the offset set as a constant attribute. The vertex array object holding all
+// this is set up by the first submit().
+class BatchRenderer
+{
+public:
+    BatchRenderer(GLBufferArena &arena);
+    virtual ~BatchRenderer();
+
+    // vertexAttrib receives the arena's elements as 4 unsigned bytes, offsetAttrib the offsets
+    void submit(const DrawBatch &batch, GLuint vertexAttrib, GLuint offsetAttrib);
+
+private:
+    void reserveIndices(std::size_t quads);
+
+    GLBufferArena &arena;
+    VAO vao;
+    GLuint commandBuffer, offsetBuffer, indexBuffer;
+    std::size_t indexQuads;  // quads covered by indexBuffer
+    int multiDraw;  // -1 until checked
+};
+
+}
+
+#endif // BATCHRENDERER_H
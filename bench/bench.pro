@@ -0,0 +1,14 @@
+# Headless benchmarks for noise, generation and meshing. Links the core only,
+# which needs QtCore and no window or GL context.
+
+QT += core
+QT -= gui
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = glube-bench
+TEMPLATE = app
+
+include(../core.pri)
+
+SOURCES += main.cpp
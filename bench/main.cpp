@@ -0,0 +1,466 @@
+// Headless benchmarks for noise, terrain generation, meshing, levels of detail, edits, culling and chunk builds.
+// Every result is printed to stdout as one JSON object per line; qDebug output
+// from the core is suppressed. Seeds and chunk coordinates are fixed so runs
+// are comparable. Pass --quick to skip the 128 voxel chunks.
+
+#include "chunk.h"
+#include "mapnode.h"
+#include "simplex.h"
+#include "terrain.h"
+#include "bufferarena.h"
+#include "frustum.h"
+#include "occlusion.h"
+#include "profiler.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// allocation counters, so each benchmark can report the bytes it allocated
+static boost::atomic<unsigned long long> allocatedBytes(0), allocations(0);
+
+void *operator new(std::size_t n)
+{
+    allocatedBytes += n;
+    ++allocations;
+    void *p = std::malloc(n ? n : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](std::size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete(void *p) throw()
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+    std::free(p);
+}
+
+namespace {
+
+const long CHUNKS[][2] = { { 0, 0 }, { 3, -2 }, { -7, 5 }, { 12, 9 } };
+const int CHUNK_COUNT = sizeof(CHUNKS) / sizeof(CHUNKS[0]);
+
+#if QT_VERSION >= 0x050000
+void quiet(QtMsgType, const QMessageLogContext &, const QString &) {}
+#else
+void quiet(QtMsgType, const char *) {}
+#endif
+
+// Measures wall time and allocations from construction or restart() until stop().
+class Measure
+{
+public:
+    Measure()
+    {
+        restart();
+    }
+
+    void restart()
+    {
+        stopped = false;
+        bytes = allocatedBytes;
+        allocs = allocations;
+        timer.start();
+    }
+
+    void stop()
+    {
+        elapsed = seconds();
+        bytes = bytesAllocated();
+        allocs = allocationCount();
+        stopped = true;
+    }
+
+    double seconds() const
+    {
+        return stopped ? elapsed : timer.nsecsElapsed() / 1e9;
+    }
+
+    unsigned long long bytesAllocated() const
+    {
+        return stopped ? bytes : allocatedBytes - bytes;
+    }
+
+    unsigned long long allocationCount() const
+    {
+        return stopped ? allocs : allocations - allocs;
+    }
+
+private:
+    QElapsedTimer timer;
+    bool stopped;
+    double elapsed;
+    unsigned long long bytes, allocs;
+};
+
+void printResult(const char *bench, const std::string &fields, const Measure &m)
+{
+    std::printf("{\"bench\":\"%s\",%s,\"seconds\":%.6f,\"bytes_allocated\":%llu,\"allocations\":%llu}\n",
+                bench, fields.c_str(), m.seconds(), m.bytesAllocated(), m.allocationCount());
+    std::fflush(stdout);
+}
+
+std::string format(const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    std::vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return buf;
+}
+
+// A chunk on its own: everything outside it is air, so results do not depend on neighbours.
+class BenchChunk: public Glube::Chunk
+{
+public:
+    BenchChunk(int size): Glube::Chunk(size) {}
+
+    void generate(const Glube::TerrainGenerator &generator, long ix, long iz)
+    {
+        assignRandom(generator, ix, 0, iz);
+    }
+
+    void mesh(int scale = 1)
+    {
+        buildQuads(scale);
+    }
+
+    void remesh()
+    {
+        remeshStale();
+    }
+
+    // takes the mesh as uploaded at first without touching GL, so its sections can be culled
+    void fakeUpload(Glube::BufferArena &arena, std::size_t first)
+    {
+        Glube::BufferArena::Allocation a;
+        a.first = first;
+        a.count = pendingVertices().size();
+        uploaded(arena, a);
+    }
+
+    virtual BlockType getBlock(int x, int y, int z)
+    {
+        const int hs = size/2;
+        if(x < -hs || x >= hs || z < -hs || z >= hs || y < 0 || y >= size) return 0;
+        return Glube::Chunk::getBlock(x, y, z);
+    }
+};
+
+void benchNoise()
+{
+    const int count = 1 << 20;
+    std::vector<float> x(count), y(count), z(count), out(count);
+    for(int i = 0; i < count; ++i) {
+        x[i] = (i % 128) / 128.0f + 500;
+        y[i] = (i / 128 % 128) / 128.0f + 500;
+        z[i] = (i / (128 * 128)) / 128.0f + 500;
+    }
+
+    {
+        Measure m;
+        float sum = 0;
+        for(int i = 0; i < count; ++i) {
+            sum += simplex_noise(1, x[i], y[i], z[i]);
+        }
+        m.stop();
+        printResult("noise", format("\"kernel\":\"simplex_noise\",\"points\":%d,\"points_per_s\":%.0f,\"checksum\":%g",
+                                    count, count / m.seconds(), sum), m);
+    }
+
+    const char *kernels[] = { "scalar", "sse4.1", "avx2" };
+    for(int k = 0; k < 3; ++k) {
+        if(!simplex_noise_use_kernel(kernels[k])) continue;
+        Measure m;
+        simplex_noise_batch(1, &x[0], &y[0], &z[0], &out[0], count);
+        m.stop();
+        const double seconds = m.seconds();
+        float sum = 0;
+        for(int i = 0; i < count; ++i) {
+            sum += out[i];
+        }
+        printResult("noise", format("\"kernel\":\"%s\",\"points\":%d,\"points_per_s\":%.0f,\"checksum\":%g",
+                                    kernels[k], count, count / seconds, sum), m);
+    }
+    simplex_noise_use_kernel("avx2") || simplex_noise_use_kernel("sse4.1");
+}
+
+void benchGenerate(int size)
+{
+    const int lattices[][3] = { { 1, 1, 1 }, { 2, 2, 2 }, { 4, 4, 4 }, { 8, 4, 8 } };
+    std::vector<Glube::Chunk::BlockType> blocks(size * size * size);
+    for(int l = 0; l < 4; ++l) {
+        Glube::TerrainGenerator generator;
+        generator.setLatticeSpacing(lattices[l][0], lattices[l][1], lattices[l][2]);
+
+        Measure m;
+        for(int c = 0; c < CHUNK_COUNT; ++c) {
+            generator.generate(CHUNKS[c][0], 0, CHUNKS[c][1], size, &blocks[0]);
+        }
+        m.stop();
+        const double seconds = m.seconds();
+        const double voxels = (double)size * size * size * CHUNK_COUNT;
+
+        std::size_t mismatched = 0;
+        if(!generator.isExact()) {
+            for(int c = 0; c < CHUNK_COUNT; ++c) {
+                mismatched += generator.compareToExact(CHUNKS[c][0], 0, CHUNKS[c][1], size).mismatched;
+            }
+        }
+        int first, end;
+        generator.noiseLayers(size, first, end);
+        printResult("generate", format("\"size\":%d,\"lattice\":\"%dx%dx%d\",\"chunks\":%d,\"voxels_per_s\":%.0f,\"mismatched_voxels\":%lu,\"noise_layers\":%d",
+                                       size, lattices[l][0], lattices[l][1], lattices[l][2], CHUNK_COUNT,
+                                       voxels / seconds, (unsigned long)mismatched, end - first), m);
+    }
+}
+
+void benchMesh(int size)
+{
+    Glube::TerrainGenerator generator;
+    const Glube::Chunk::MeshMode modes[] = { Glube::Chunk::NaiveMesh, Glube::Chunk::GreedyMesh };
+    const char *names[] = { "naive", "greedy" };
+    for(int mode = 0; mode < 2; ++mode) {
+        std::vector<BenchChunk*> chunks;
+        for(int c = 0; c < CHUNK_COUNT; ++c) {
+            chunks.push_back(new BenchChunk(size));
+            chunks.back()->generate(generator, CHUNKS[c][0], CHUNKS[c][1]);
+            chunks.back()->setMeshMode(modes[mode]);
+        }
+
+        Measure m;
+        std::size_t quads = 0;
+        for(int c = 0; c < CHUNK_COUNT; ++c) {
+            chunks[c]->mesh();
+            quads += chunks[c]->quadCount();
+        }
+        m.stop();
+        const double seconds = m.seconds();
+        const double voxels = (double)size * size * size * CHUNK_COUNT;
+        printResult("mesh", format("\"size\":%d,\"mode\":\"%s\",\"chunks\":%d,\"quads\":%lu,\"quads_per_s\":%.0f,\"voxels_per_s\":%.0f",
+                                   size, names[mode], CHUNK_COUNT, (unsigned long)quads, quads / seconds, voxels / seconds), m);
+
+        for(int c = 0; c < CHUNK_COUNT; ++c) {
+            delete chunks[c];
+        }
+    }
+}
+
+// Meshes the chunks at each level of detail, as distant chunks are.
+void benchLod(int size)
+{
+    Glube::TerrainGenerator generator;
+    std::vector<BenchChunk*> chunks;
+    for(int c = 0; c < CHUNK_COUNT; ++c) {
+        chunks.push_back(new BenchChunk(size));
+        chunks.back()->generate(generator, CHUNKS[c][0], CHUNKS[c][1]);
+        chunks.back()->setMeshMode(Glube::Chunk::GreedyMesh);
+    }
+    for(int scale = 1; scale <= 8; scale *= 2) {
+        Measure m;
+        std::size_t quads = 0;
+        for(int c = 0; c < CHUNK_COUNT; ++c) {
+            chunks[c]->mesh(scale);
+            quads += chunks[c]->quadCount();
+        }
+        m.stop();
+        printResult("lod", format("\"size\":%d,\"scale\":%d,\"chunks\":%d,\"quads\":%lu,\"ms_per_chunk\":%.3f",
+                                  size, scale, CHUNK_COUNT, (unsigned long)quads, m.seconds() * 1000 / CHUNK_COUNT), m);
+    }
+    for(int c = 0; c < CHUNK_COUNT; ++c) {
+        delete chunks[c];
+    }
+}
+
+// Edits single blocks of a meshed chunk and remeshes the stale sections after each edit.
+void benchEdit(int size)
+{
+    Glube::TerrainGenerator generator;
+    const int edits = 200;
+    BenchChunk chunk(size);
+    chunk.generate(generator, CHUNKS[0][0], CHUNKS[0][1]);
+    chunk.setMeshMode(Glube::Chunk::GreedyMesh);
+    chunk.mesh();
+
+    Measure m;
+    unsigned seed = 1;
+    for(int i = 0; i < edits; ++i) {
+        seed = seed * 1103515245 + 12345;
+        const int x = (seed >> 8) % size - size/2, y = (seed >> 12) % size, z = (seed >> 20) % size - size/2;
+        chunk.setBlock(x, y, z, chunk.getBlock(x, y, z) ? 0 : 1);
+        chunk.remesh();
+    }
+    m.stop();
+    printResult("edit", format("\"size\":%d,\"edits\":%d,\"ms_per_edit\":%.3f", size, edits, m.seconds() * 1000 / edits), m);
+}
+
+// Culls the meshed sections of a grid x grid block of chunks seen from the surface at its
+// centre, looking along x: frustum first, then occlusion by the nearest chunks' solid sections.
+void benchOcclusion(int size)
+{
+    const int grid = 5, frames = 20;
+    Glube::TerrainGenerator generator;
+    Glube::BufferArena arena(sizeof(Glube::Chunk::Vertex), 0);
+    std::vector<BenchChunk*> chunks;
+    std::vector<glm::vec3> offsets;
+    std::size_t first = 0;
+    for(int gz = 0; gz < grid; ++gz) {
+        for(int gx = 0; gx < grid; ++gx) {
+            BenchChunk *chunk = new BenchChunk(size);
+            chunk->generate(generator, gx - grid/2, gz - grid/2);
+            chunk->setMeshMode(Glube::Chunk::GreedyMesh);
+            chunk->mesh();
+            chunk->fakeUpload(arena, first);
+            first += chunk->quadCount() * 4;
+            chunks.push_back(chunk);
+            offsets.push_back(glm::vec3((gx - grid/2) * size, 0, (gz - grid/2) * size) + chunk->meshOrigin());
+        }
+    }
+
+    BenchChunk *centre = chunks[grid * grid / 2];
+    int ground = size - 1;
+    while(ground > 0 && !centre->getBlock(0, ground, 0)) --ground;
+    const glm::vec3 eye(0.5f, ground + 2.5f, 0.5f);
+    const glm::mat4 viewProjection = glm::perspective(float(M_PI / 4), 16.0f / 9, 0.1f, size * 3.0f)
+            * glm::lookAt(eye, eye + glm::vec3(1, 0, 0), glm::vec3(0, 1, 0));
+
+    Glube::Frustum frustum(viewProjection);
+    Glube::OcclusionCuller occlusion(256, 128);
+    Glube::BoxList sections, occluders;
+    std::vector<unsigned char> visible;
+    std::size_t inFrustum = 0, hidden = 0;
+    Measure m;
+    for(int f = 0; f < frames; ++f) {
+        occluders.clear();
+        sections.clear();
+        for(std::size_t c = 0; c < chunks.size(); ++c) {
+            glm::vec3 d = offsets[c] - chunks[c]->meshOrigin() - eye;
+            if(glm::length(glm::vec2(d.x, d.z)) < size * 1.5f) chunks[c]->occluderBoxes(occluders, offsets[c]);
+            chunks[c]->sectionBoxes(sections, offsets[c]);
+        }
+        occlusion.render(occluders, viewProjection);
+        frustum.cull(sections, visible);
+        inFrustum = std::count(visible.begin(), visible.end(), 1);
+        hidden = occlusion.cull(sections, visible);
+    }
+    m.stop();
+    printResult("occlusion", format("\"size\":%d,\"chunks\":%d,\"sections\":%lu,\"occluders\":%lu,\"in_frustum\":%lu,\"occluded\":%lu,\"ms_per_frame\":%.3f",
+                                    size, grid * grid, (unsigned long)sections.size(), (unsigned long)occluders.size(),
+                                    (unsigned long)inFrustum, (unsigned long)hidden, m.seconds() * 1000 / frames), m);
+
+    for(std::size_t c = 0; c < chunks.size(); ++c) {
+        delete chunks[c];
+    }
+}
+
+// Builds a grid x grid block of map nodes on a pool of the given size and waits for all of them.
+std::size_t buildGrid(int size, unsigned threads, int grid, Measure &m)
+{
+    Glube::MapNodeFactory factory(size, threads);
+    factory.setMeshMode(Glube::Chunk::GreedyMesh);
+
+    // create the nodes and their outer ring up front, so builds only look nodes up
+    std::vector<shared_ptr<Glube::MapNode> > nodes;
+    for(int x = -1; x <= grid; ++x) {
+        for(int z = -1; z <= grid; ++z) {
+            shared_ptr<Glube::MapNode> node = factory.getMapNode(x, z);
+            if(x >= 0 && x < grid && z >= 0 && z < grid) nodes.push_back(node);
+        }
+    }
+
+    m.restart();
+    for(std::size_t i = 0; i < nodes.size(); ++i) {
+        nodes[i]->startBuild();
+    }
+    for(std::size_t i = 0; i < nodes.size(); ++i) {
+        while(!nodes[i]->isBuilt()) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+        }
+    }
+    m.stop();
+
+    std::size_t quads = 0;
+    for(std::size_t i = 0; i < nodes.size(); ++i) {
+        quads += nodes[i]->quadCount();
+    }
+    return quads;
+}
+
+void benchBuild(int size)
+{
+    const int grid = 4;
+    std::vector<unsigned> threadCounts;
+    const unsigned cores = std::max(1u, boost::thread::hardware_concurrency());
+    for(unsigned t = 1; t < cores; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(cores);
+
+    double single = 0;
+    for(std::size_t i = 0; i < threadCounts.size(); ++i) {
+        Measure m;
+        const std::size_t quads = buildGrid(size, threadCounts[i], grid, m);
+        if(i == 0) single = m.seconds();
+        printResult("build", format("\"size\":%d,\"threads\":%u,\"nodes\":%d,\"nodes_per_s\":%.2f,\"quads\":%lu,\"speedup\":%.2f",
+                                    size, threadCounts[i], grid * grid, grid * grid / m.seconds(),
+                                    (unsigned long)quads, single / m.seconds()), m);
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+#if QT_VERSION >= 0x050000
+    qInstallMessageHandler(quiet);
+#else
+    qInstallMsgHandler(quiet);
+#endif
+    // the scopes in jobs and builds would all land in one frame, counted as
+    // allocations and serialising the threads on the profiler's lock
+    Glube::Profiler::instance().setEnabled(false);
+
+    std::vector<int> sizes;
+    sizes.push_back(32);
+    sizes.push_back(64);
+    if(!app.arguments().contains("--quick")) sizes.push_back(128);
+
+    std::printf("{\"bench\":\"info\",\"noise_kernel\":\"%s\",\"cores\":%u}\n",
+                simplex_noise_kernel(), boost::thread::hardware_concurrency());
+
+    benchNoise();
+    for(std::size_t i = 0; i < sizes.size(); ++i) {
+        benchGenerate(sizes[i]);
+        benchMesh(sizes[i]);
+        benchLod(sizes[i]);
+        benchEdit(sizes[i]);
+        benchOcclusion(sizes[i]);
+        benchBuild(sizes[i]);
+    }
+    return 0;
+}
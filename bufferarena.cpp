@@ -0,0 +1,108 @@
+#include "bufferarena.h"
+
+#include <QDebug>
+
+#include <algorithm>
+
+namespace Glube {
+
+BufferArena::BufferArena(std::size_t elementSize_, std::size_t initialElements):
+    size(elementSize_),
+    initial(initialElements),
+    elements(0),
+    inUse(0),
+    freeBlocks()
+{
+}
+
+BufferArena::~BufferArena()
+{
+}
+
+BufferArena::Allocation BufferArena::allocate(std::size_t count)
+{
+    Allocation a;
+    if(!count) return a;
+
+    std::map<std::size_t, std::size_t>::iterator i = freeBlocks.begin();
+    while(i != freeBlocks.end() && i->second < count)
+        ++i;
+    if(i == freeBlocks.end()) {
+        grow(count);
+        // the last block now ends at the end of the buffer and is big enough
+        i = --freeBlocks.end();
+    }
+
+    a.first = i->first;
+    a.count = count;
+    if(i->second > count) freeBlocks[i->first + count] = i->second - count;
+    freeBlocks.erase(i);
+    inUse += count;
+    return a;
+}
+
+void BufferArena::free(Allocation &a)
+{
+    if(!a.count) return;
+    inUse -= a.count;
+
+    std::map<std::size_t, std::size_t>::iterator i = freeBlocks.insert(std::make_pair(a.first, a.count)).first;
+    // merge with the following block, then with the preceding one
+    std::map<std::size_t, std::size_t>::iterator next = i;
+    ++next;
+    if(next != freeBlocks.end() && i->first + i->second == next->first) {
+        i->second += next->second;
+        freeBlocks.erase(next);
+    }
+    if(i != freeBlocks.begin()) {
+        std::map<std::size_t, std::size_t>::iterator prev = i;
+        --prev;
+        if(prev->first + prev->second == i->first) {
+            prev->second += i->second;
+            freeBlocks.erase(i);
+        }
+    }
+    a = Allocation();
+}
+
+std::size_t BufferArena::elementSize() const
+{
+    return size;
+}
+
+std::size_t BufferArena::capacity() const
+{
+    return elements;
+}
+
+std::size_t BufferArena::used() const
+{
+    return inUse;
+}
+
+void BufferArena::resize(std::size_t, std::size_t)
+{
+}
+
+void BufferArena::grow(std::size_t minimum)
+{
+    // the free block at the end of the buffer, if any, is extended rather than replaced
+    std::size_t tail = 0;
+    if(!freeBlocks.empty()) {
+        std::map<std::size_t, std::size_t>::iterator last = --freeBlocks.end();
+        if(last->first + last->second == elements) tail = last->second;
+    }
+    const std::size_t newElements = std::max(std::max(initial, elements * 2), elements - tail + minimum);
+
+    resize(elements, newElements);
+
+    if(tail) {
+        (--freeBlocks.end())->second += newElements - elements;
+    } else {
+        freeBlocks[elements] = newElements - elements;
+    }
+    qDebug() << "Buffer arena grown to" << newElements * size << "bytes," << inUse * size << "in use";
+    elements = newElements;
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef BUFFERARENA_H
+#define BUFFERARENA_H
+
+#include <cstddef>
+#include <map>
+
+namespace Glube {
+
+// Space for many meshes in one buffer. It is handed out in elements of a fixed size
+// from a first-fit free list that merges neighbouring free blocks. When no block is
+// big enough the arena grows and allocations keep their place. This is only the
+// bookkeeping; the storage is kept by a subclass, GLBufferArena for the GPU, which
+// resize() tells about each growth.
+class BufferArena
+{
+public:
+    struct Allocation {
+        Allocation(): first(0), count(0) {}
+        std::size_t first, count;  // in elements; count 0 is no allocation
+    };
+
+    BufferArena(std::size_t elementSize, std::size_t initialElements);
+    virtual ~BufferArena();
+
+    Allocation allocate(std::size_t count);
+    void free(Allocation &a);
+
+    std::size_t elementSize() const;
+    std::size_t capacity() const;
+    std::size_t used() const;
+
+protected:
+    // called from allocate() as the arena grows; the first oldElements have to be kept
+    virtual void resize(std::size_t oldElements, std::size_t newElements);
+
+private:
+    void grow(std::size_t minimum);
+
+    std::size_t size;
+    std::size_t initial;
+    std::size_t elements;
+    std::size_t inUse;
+    std::map<std::size_t, std::size_t> freeBlocks;  // first element -> count
+};
+
+}
+
+#endif // BUFFERARENA_H
@@ -1,5 +1,9 @@
 #include "chunk.h"
-#include "simplex.h"
+#include "terrain.h"
+#include "region.h"
+#include "section.h"
+#include "drawbatch.h"
+#include "frustum.h"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -8,14 +12,33 @@
 
 #include <QDebug>
 
+#include <algorithm>
+
 namespace Glube {
 
+// bit for the pair of faces a < b in a section's connectivity
+static int connectionBit(int a, int b)
+{
+    return a * 6 - a * (a + 1) / 2 + (b - a - 1);
+}
+
+static const unsigned short ALL_CONNECTED = (1 << 15) - 1;
+
 Chunk::Chunk(int size_):
     size(size_),
-    blockData(new unsigned char[size_ * size_ * size_]),
+    sectionCount((size_ + Section::Size - 1) / Section::Size),
+    visitedFrame(sectionCount * sectionCount * sectionCount, 0),
+    sections(new Section[sectionCount * sectionCount * sectionCount]),
     blockDataReady(false),
-    vertexBuffer(0),
-    normalBuffer(0),
+    dirty(false),
+    meshMode(NaiveMesh),
+    meshScale(1),
+    staleSections(sectionCount * sectionCount * sectionCount, false),
+    sectionMeshes(sectionCount * sectionCount * sectionCount),
+    connectivity(sectionCount * sectionCount * sectionCount, ALL_CONNECTED),
+    arena(0),
+    allocation(),
+    uploadPending(false),
     quads(0)
 {
 }
@@ -24,208 +47,834 @@ Chunk::~Chunk() {
     deleteBuffers();
 }
 
-void Chunk::draw() {
-    if(quads != 0) {
-        copyDataToGPU();
+void Chunk::draw(DrawBatch &batch, const glm::vec3 &offset, const glm::vec3 &eye, const unsigned char *visible) {
+    // until a changed mesh is uploaded the previous one is drawn
+    if(!allocation.count) return;
 
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(
-           0,                  // attribute 0. No particular reason for 0, but must match the layout in the shader.
-           3,                  // size
-           GL_FLOAT,           // type
-           GL_FALSE,           // normalized?
-           0,                  // stride
-           (void*)0            // array buffer offset
-        );
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(
-           1,                  // attribute 1. No particular reason for 0, but must match the layout in the shader.
-           3,                  // size
-           GL_FLOAT,           // type
-           GL_FALSE,           // normalized?
-           0,                  // stride
-           (void*)0            // array buffer offset
-        );
+    // A section's +x faces lie on planes no lower than its least x, so from there
+    // down none of them face the eye; likewise for the other directions. What's
+    // left next to each other in the buffer goes in one draw.
+    const glm::vec3 local = eye - offset;
+    BufferArena::Allocation run;
+    for(int face = 0; face < 6; ++face) {
+        const int axis = face / 2;
+        for(std::size_t i = 0; i < drawnRanges.size(); ++i) {
+            const MeshRange &r = drawnRanges[i];
+            if(!r.count[face] || (visible && !visible[i])) continue;
+            const int c[3] = { r.section % sectionCount, r.section / sectionCount % sectionCount,
+                               r.section / (sectionCount * sectionCount) };
+            const float min = c[axis] * Section::Size;
+            const float max = std::min(min + Section::Size, (float)size);
+            if(face & 1 ? local[axis] <= min : local[axis] >= max) continue;
 
-        glDrawArrays(GL_QUADS, 0, quads * 4);
+            if(run.count && run.first + run.count == allocation.first + r.first[face]) {
+                run.count += r.count[face];
+            } else {
+                batch.add(run, offset);
+                run.first = allocation.first + r.first[face];
+                run.count = r.count[face];
+            }
+        }
+    }
+    batch.add(run, offset);
+}
 
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(0);
+std::size_t Chunk::sectionBoxes(BoxList &boxes, const glm::vec3 &offset) const
+{
+    if(!allocation.count) return 0;
+    for(std::size_t i = 0; i < drawnRanges.size(); ++i) {
+        const int section = drawnRanges[i].section;
+        const glm::vec3 corner(section % sectionCount,
+                               section / sectionCount % sectionCount,
+                               section / (sectionCount * sectionCount));
+        const glm::vec3 min = corner * (float)Section::Size;
+        const glm::vec3 max = glm::min(min + (float)Section::Size, glm::vec3((float)size));
+        boxes.add(offset + min, offset + max);
     }
+    return drawnRanges.size();
 }
 
 void Chunk::deleteBuffers()
 {
-    if(normalBuffer && vertexBuffer) {
-        if(glIsBuffer(normalBuffer)) glDeleteBuffers(1, &normalBuffer);
-        if(glIsBuffer(vertexBuffer)) glDeleteBuffers(1, &vertexBuffer);
-        normalBuffer = 0;
-        vertexBuffer = 0;
-    }
+    if(arena) arena->free(allocation);
+}
+
+glm::vec3 Chunk::meshOrigin() const
+{
+    return glm::vec3(-size/2 - 0.5f, -0.5f, -size/2 - 0.5f);
+}
+
+Section &Chunk::sectionAt(int x, int y, int z)
+{
+    x += size/2;
+    z += size/2;
+    return sections[(x >> Section::Shift) + ((y >> Section::Shift) + (z >> Section::Shift) * sectionCount) * sectionCount];
+}
+
+static int indexInSection(int x, int y, int z, int size)
+{
+    const int m = Section::Size - 1;
+    return ((x + size/2) & m) + ((y & m) + ((z + size/2) & m) * Section::Size) * Section::Size;
+}
+
+// a section filled with one kind of block other than air
+static bool isSolid(const Section &section)
+{
+    return section.isUniform() && section.uniformValue() != 0;
 }
 
 Chunk::BlockType Chunk::getBlock(int x, int y, int z)
 {
     boost::mutex::scoped_lock lock(m_mutex);
-    return blockData[x + size/2 + y * size + (z + size/2) * size * size];
+    return sectionAt(x, y, z).get(indexInSection(x, y, z, size));
 }
 
 void Chunk::setBlock(int x, int y, int z, Chunk::BlockType value)
 {
-    blockData[x + size/2 + y * size + (z + size/2) * size * size] = value;
-    deleteBuffers();
+    boost::mutex::scoped_lock lock(m_mutex);
+    sectionAt(x, y, z).set(indexInSection(x, y, z, size), value);
+    dirty = true;
+    // the faces of the block and of its six neighbours can change
+    markStaleLocked(x, y, z);
+    markStaleLocked(x - 1, y, z);
+    markStaleLocked(x + 1, y, z);
+    markStaleLocked(x, y - 1, z);
+    markStaleLocked(x, y + 1, z);
+    markStaleLocked(x, y, z - 1);
+    markStaleLocked(x, y, z + 1);
 }
 
-void Chunk::assignRandom(long ix, long iy, long iz)
+void Chunk::markStale(int x, int y, int z)
 {
     boost::mutex::scoped_lock lock(m_mutex);
-    if(!blockDataReady) {
-        qDebug() << "Generating block data for (" << ix << "," << iy << "," << iz << ")";
-        const int hs = size/2;
-        for(int x = -hs; x < hs; ++x) {
-            for(int y = 0; y < size; ++y) {
-                for(int z = -hs; z < hs; ++z) {
-                    const float n = simplex_noise(1, x / (float)hs/2 + ix + 500, y / (float)size + iy + 500, z / (float)hs/2 + iz + 500);
-                    //const float hf = (y < size/2 ? 1 : 1 - (y - size/2) / (float)(size / 2));
-                    const float hf = pow((1 - y/(float)size) * 2, 2);
-                    BlockType block = n * hf > 1.0f ? 0 : 1;
-                    setBlock(x, y, z, block);
-
-                    sched_yield();
+    markStaleLocked(x, y, z);
+}
+
+void Chunk::markStaleLocked(int x, int y, int z)
+{
+    const int hs = size/2;
+    if(x < -hs || x >= hs || y < 0 || y >= size || z < -hs || z >= hs) return;
+    x += hs;
+    z += hs;
+    staleSections[(x >> Section::Shift) + ((y >> Section::Shift) + (z >> Section::Shift) * sectionCount) * sectionCount] = true;
+}
+
+void Chunk::packBlocks(const BlockType *blocks)
+{
+    const int n = Section::Size;
+    std::vector<BlockType> tile;
+    for(int sz = 0; sz < sectionCount; ++sz) {
+        for(int sy = 0; sy < sectionCount; ++sy) {
+            for(int sx = 0; sx < sectionCount; ++sx) {
+                Section &section = sections[sx + (sy + sz * sectionCount) * sectionCount];
+                const BlockType *first = blocks + (sx + (sy * size + sz * size * size)) * n;
+                const int w = std::min(n, size - sx * n), h = std::min(n, size - sy * n), d = std::min(n, size - sz * n);
+                if(w == n && h == n && d == n) {
+                    section.fill(first, size, size * size);
+                    continue;
+                }
+                // sections past the end of the chunk are padded with air
+                tile.assign(Section::Volume, 0);
+                for(int z = 0; z < d; ++z) {
+                    for(int y = 0; y < h; ++y) {
+                        std::copy(first + y * size + z * size * size, first + y * size + z * size * size + w,
+                                  tile.begin() + (y + z * n) * n);
+                    }
                 }
+                section.fill(&tile[0], n, n * n);
             }
         }
-        blockDataReady = true;
+    }
+}
+
+void Chunk::unpackBlocks(BlockType *blocks, int yStride, int zStride)
+{
+    const int n = Section::Size;
+    std::vector<BlockType> tile(Section::Volume);
+    for(int sz = 0; sz < sectionCount; ++sz) {
+        for(int sy = 0; sy < sectionCount; ++sy) {
+            for(int sx = 0; sx < sectionCount; ++sx) {
+                const Section &section = sections[sx + (sy + sz * sectionCount) * sectionCount];
+                BlockType *first = blocks + (sx + sy * yStride + sz * zStride) * n;
+                const int w = std::min(n, size - sx * n), h = std::min(n, size - sy * n), d = std::min(n, size - sz * n);
+                if(w == n && h == n && d == n) {
+                    section.copyTo(first, yStride, zStride);
+                    continue;
+                }
+                section.copyTo(&tile[0], n, n * n);
+                for(int z = 0; z < d; ++z) {
+                    for(int y = 0; y < h; ++y) {
+                        std::copy(tile.begin() + (y + z * n) * n, tile.begin() + (y + z * n) * n + w,
+                                  first + y * yStride + z * zStride);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Chunk::snapshot(Snapshot &s, int sx0, int sx1, int sy0, int sy1, int sz0, int sz1)
+{
+    const int n = Section::Size;
+    s.x0 = sx0 * n - 1;
+    s.y0 = std::max(0, sy0 * n - 1);
+    s.z0 = sz0 * n - 1;
+    s.width = std::min(sx1 * n, size) + 1 - s.x0;
+    s.height = std::min(sy1 * n + 1, size) - s.y0;
+    s.depth = std::min(sz1 * n, size) + 1 - s.z0;
+    s.blocks.assign((std::size_t)s.width * s.height * s.depth, 0);
+    s.uniform.resize(sectionCount * sectionCount * sectionCount);
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        copyBlocks(s, 0, 0);
+        for(std::size_t i = 0; i < s.uniform.size(); ++i) {
+            s.uniform[i] = sections[i].isUniform() ? sections[i].uniformValue() : -1;
+        }
+        for(int sz = sz0; sz < sz1; ++sz) {
+            for(int sy = sy0; sy < sy1; ++sy) {
+                for(int sx = sx0; sx < sx1; ++sx) {
+                    staleSections[sx + (sy + sz * sectionCount) * sectionCount] = false;
+                }
+            }
+        }
+    }
+    snapshotApron(s);
+}
+
+void Chunk::snapshotApron(Snapshot &)
+{
+}
+
+void Chunk::copyInto(Snapshot &s, int dx, int dz)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    if(blockDataReady) copyBlocks(s, dx, dz);
+}
+
+void Chunk::copyBlocks(Snapshot &s, int dx, int dz)
+{
+    const int n = Section::Size;
+    const int x0 = std::max(0, s.x0 - dx), x1 = std::min(size, s.x0 + s.width - dx);
+    const int y0 = std::max(0, s.y0), y1 = std::min(size, s.y0 + s.height);
+    const int z0 = std::max(0, s.z0 - dz), z1 = std::min(size, s.z0 + s.depth - dz);
+    if(x0 >= x1 || y0 >= y1 || z0 >= z1) return;
+
+    for(int sz = z0 / n * n; sz < z1; sz += n) {
+        for(int sy = y0 / n * n; sy < y1; sy += n) {
+            for(int sx = x0 / n * n; sx < x1; sx += n) {
+                const Section &section = sections[sx / n + (sy / n + sz / n * sectionCount) * sectionCount];
+                if(sx >= x0 && sx + n <= x1 && sy >= y0 && sy + n <= y1 && sz >= z0 && sz + n <= z1) {
+                    section.copyTo(&s.blocks[s.index(sx + dx, sy, sz + dz)], s.width, s.width * s.height);
+                    continue;
+                }
+                // sections cut by the edge of the box, a block at a time
+                for(int z = std::max(sz, z0); z < std::min(sz + n, z1); ++z) {
+                    for(int y = std::max(sy, y0); y < std::min(sy + n, y1); ++y) {
+                        for(int x = std::max(sx, x0); x < std::min(sx + n, x1); ++x) {
+                            s.blocks[s.index(x + dx, y, z + dz)] = section.get((x - sx) + ((y - sy) + (z - sz) * n) * n);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void Chunk::setMeshMode(Chunk::MeshMode mode)
+{
+    meshMode = mode;
+}
+
+int Chunk::getMeshScale() const
+{
+    return meshScale;
+}
+
+std::size_t Chunk::quadCount() const
+{
+    return quads;
+}
+
+std::size_t Chunk::memoryUsage() const
+{
+    std::size_t bytes = verts.capacity() * sizeof(Vertex);
+    for(int i = 0; i < sectionCount * sectionCount * sectionCount; ++i) {
+        bytes += sections[i].memoryUsage() + sectionMeshes[i].capacity() * sizeof(Vertex);
+    }
+    return bytes;
+}
+
+bool Chunk::facesConnected(int section, int a, int b) const
+{
+    if(a == b) return true;
+    if(a > b) std::swap(a, b);
+    return connectivity[section] & (1 << connectionBit(a, b));
+}
+
+void Chunk::cullUnvisited(unsigned frame, unsigned char *visible) const
+{
+    if(!allocation.count) return;
+    for(std::size_t i = 0; i < drawnRanges.size(); ++i) {
+        if(visitedFrame[drawnRanges[i].section] != frame) visible[i] = 0;
+    }
+}
+
+std::size_t Chunk::occluderBoxes(BoxList &boxes, const glm::vec3 &offset)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    if(!blockDataReady) return 0;
+    std::size_t count = 0;
+    const float edge = Section::Size;
+    for(int sz = 0; sz < sectionCount; ++sz) {
+        for(int sx = 0; sx < sectionCount; ++sx) {
+            // sections under the top run are hidden by it from above, so leave them out
+            int top = sectionCount - 1;
+            while(top >= 0 && !isSolid(sections[sx + (top + sz * sectionCount) * sectionCount]))
+                --top;
+            if(top < 0) continue;
+            int bottom = top;
+            while(bottom > 0 && isSolid(sections[sx + (bottom - 1 + sz * sectionCount) * sectionCount]))
+                --bottom;
+            const glm::vec3 min(sx * edge, bottom * edge, sz * edge);
+            const glm::vec3 max = glm::min(glm::vec3(sx + 1, top + 1, sz + 1) * edge, glm::vec3((float)size));
+            boxes.add(offset + min, offset + max);
+            ++count;
+        }
+    }
+    return count;
+}
+
+void Chunk::assignRandom(const TerrainGenerator &generator, long ix, long iy, long iz, RegionStore *store)
+{
+    // loading and generating hold only m_assignMutex, so the chunk stays readable meanwhile
+    boost::mutex::scoped_lock assigning(m_assignMutex);
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        if(blockDataReady) return;
+    }
+    // generation and region files work on dense block data, packed into sections afterwards
+    scoped_array<BlockType> blocks(new BlockType[size * size * size]);
+    if(store && store->load(ix, iz, blocks.get())) {
+        qDebug() << "Loaded block data for (" << ix << "," << iy << "," << iz << ")";
+    } else {
+        qDebug() << "Generating block data for (" << ix << "," << iy << "," << iz << ")";
+        generator.generate(ix, iy, iz, size, blocks.get());
         qDebug() << "Generated block data for (" << ix << "," << iy << "," << iz << ")";
     }
+    boost::mutex::scoped_lock lock(m_mutex);
+    packBlocks(blocks.get());
+    blockDataReady = true;
+    dirty = false;
 }
 
+void Chunk::save(RegionStore *store, long ix, long iz)
+{
+    scoped_array<BlockType> blocks;
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        if(!store || !blockDataReady || !dirty) return;
+        blocks.reset(new BlockType[size * size * size]);
+        unpackBlocks(blocks.get(), size, size * size);
+        dirty = false;
+    }
+    // edits made while writing set dirty again and are saved next time
+    if(!store->save(ix, iz, blocks.get())) {
+        boost::mutex::scoped_lock lock(m_mutex);
+        dirty = true;
+    }
+}
 
-#define push(v, x, y, z) v.push_back(x); v.push_back(y); v.push_back(z);
-void Chunk::buildQuads()
+
+void Chunk::buildQuads(int scale)
 {
     if(!blockDataReady)
         return;
 
-    std::vector<float> rVerts, rNormals;
-    std::size_t rQuads = 0;
-    const int hs = size/2;
-    for(int x = -hs; x < hs; ++x)
+    Snapshot s;
+    snapshot(s, 0, sectionCount, 0, sectionCount, 0, sectionCount);
+    meshSections(s, scale, sectionMeshes, &connectivity);
+    meshScale = scale;
+    joinSectionMeshes();
+
+    qDebug() << "Quads:" << quads << ", verts" << verts.size();
+}
+
+void Chunk::buildMeshes(int scale, std::vector<std::vector<Vertex> > &meshes, std::vector<unsigned short> &connections)
+{
+    if(!blockDataReady)
+        return;
+
+    Snapshot s;
+    snapshot(s, 0, sectionCount, 0, sectionCount, 0, sectionCount);
+    connections.resize(connectivity.size());
+    meshSections(s, scale, meshes, &connections);
+}
+
+void Chunk::setMeshes(std::vector<std::vector<Vertex> > &meshes, std::vector<unsigned short> &connections, int scale)
+{
+    if(meshes.size() != sectionMeshes.size() || connections.size() != connectivity.size()) return;
+    sectionMeshes.swap(meshes);
+    connectivity.swap(connections);
+    meshScale = scale;
+    joinSectionMeshes();
+}
+
+void Chunk::meshSections(const Snapshot &s, int scale, std::vector<std::vector<Vertex> > &meshes,
+                         std::vector<unsigned short> *connections)
+{
+    std::vector<BlockType> cells;
+    if(scale > 1) downsample(s, scale, cells);
+    meshes.resize(sectionCount * sectionCount * sectionCount);
+
+    for(int sz = 0, i = 0; sz < sectionCount; ++sz) {
+        for(int sy = 0; sy < sectionCount; ++sy) {
+            for(int sx = 0; sx < sectionCount; ++sx, ++i) {
+                std::vector<Vertex> rVerts;
+                if(scale > 1) {
+                    buildQuadsCoarse(cells, scale, sx, sy, sz, rVerts);
+                } else {
+                    switch(meshMode) {
+                    case NaiveMesh: buildQuadsNaive(s, sx, sy, sz, rVerts); break;
+                    case GreedyMesh: buildQuadsGreedy(s, sx, sy, sz, rVerts); break;
+                    }
+                }
+                meshes[i].swap(rVerts);
+                if(connections) (*connections)[i] = connectivityOf(s, sx, sy, sz);
+            }
+        }
+    }
+}
+
+bool Chunk::hasStaleSections()
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    return std::find(staleSections.begin(), staleSections.end(), true) != staleSections.end();
+}
+
+bool Chunk::remeshStale(std::size_t maxSections)
+{
+    if(meshScale > 1 || !blockDataReady)
+        return false;
+
+    // the rest stay stale for the next call
+    std::vector<int> stale;
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        for(std::size_t i = 0; i < staleSections.size() && (!maxSections || stale.size() < maxSections); ++i) {
+            if(staleSections[i]) stale.push_back(i);
+        }
+    }
+    if(stale.empty())
+        return false;
+
+    Snapshot s;
+    for(std::size_t i = 0; i < stale.size(); ++i) {
+        const int sx = stale[i] % sectionCount, sy = stale[i] / sectionCount % sectionCount, sz = stale[i] / (sectionCount * sectionCount);
+        snapshot(s, sx, sx + 1, sy, sy + 1, sz, sz + 1);
+        std::vector<Vertex> rVerts;
+        switch(meshMode) {
+        case NaiveMesh: buildQuadsNaive(s, sx, sy, sz, rVerts); break;
+        case GreedyMesh: buildQuadsGreedy(s, sx, sy, sz, rVerts); break;
+        }
+        sectionMeshes[stale[i]].swap(rVerts);
+        connectivity[stale[i]] = connectivityOf(s, sx, sy, sz);
+    }
+    joinSectionMeshes();
+    return true;
+}
+
+unsigned short Chunk::connectivityOf(const Snapshot &s, int sx, int sy, int sz) const
+{
+    const int uniform = s.uniform[sx + (sy + sz * sectionCount) * sectionCount];
+    if(uniform == 0) return ALL_CONNECTED;
+    if(uniform > 0) return 0;
+
+    // flood fill each pocket of air and connect every pair of faces it touches
+    const int n = Section::Size;
+    const int x0 = sx * n, y0 = sy * n, z0 = sz * n;
+    const int w = std::min(n, size - x0), h = std::min(n, size - y0), d = std::min(n, size - z0);
+    bool seen[Section::Volume] = { false };
+    int stack[Section::Volume];
+    unsigned short connected = 0;
+    for(int start = 0; start < n * n * n && connected != ALL_CONNECTED; ++start) {
+        const int sx0 = start % n, sy0 = start / n % n, sz0 = start / (n * n);
+        if(seen[start] || sx0 >= w || sy0 >= h || sz0 >= d || s.at(x0 + sx0, y0 + sy0, z0 + sz0)) continue;
+
+        int faces = 0, top = 0;
+        stack[top++] = start;
+        seen[start] = true;
+        while(top) {
+            const int i = stack[--top];
+            const int c[3] = { i % n, i / n % n, i / (n * n) };
+            const int extent[3] = { w, h, d };
+            const int stride[3] = { 1, n, n * n };
+            for(int axis = 0; axis < 3; ++axis) {
+                if(c[axis] == 0) faces |= 1 << (axis * 2);
+                if(c[axis] == extent[axis] - 1) faces |= 1 << (axis * 2 + 1);
+                for(int dir = -1; dir <= 1; dir += 2) {
+                    const int next = c[axis] + dir;
+                    if(next < 0 || next >= extent[axis]) continue;
+                    const int j = i + dir * stride[axis];
+                    if(seen[j]) continue;
+                    int b[3] = { c[0], c[1], c[2] };
+                    b[axis] = next;
+                    if(s.at(x0 + b[0], y0 + b[1], z0 + b[2])) continue;
+                    seen[j] = true;
+                    stack[top++] = j;
+                }
+            }
+        }
+        for(int a = 0; a < 6; ++a) {
+            for(int b = a + 1; b < 6; ++b) {
+                if((faces & (1 << a)) && (faces & (1 << b))) connected |= 1 << connectionBit(a, b);
+            }
+        }
+    }
+    return connected;
+}
+
+void Chunk::joinSectionMeshes()
+{
+    // count each section's quads by direction, lay the directions out one after
+    // another, then copy every quad to its place
+    std::size_t count = 0;
+    ranges.clear();
+    for(std::size_t i = 0; i < sectionMeshes.size(); ++i) {
+        const std::vector<Vertex> &mesh = sectionMeshes[i];
+        if(mesh.empty()) continue;
+        MeshRange r;
+        std::fill(r.count, r.count + 6, 0);
+        r.section = i;
+        for(std::size_t v = 0; v < mesh.size(); v += 4) {
+            r.count[mesh[v].attrib & 7] += 4;
+        }
+        ranges.push_back(r);
+        count += mesh.size();
+    }
+    std::size_t first = 0;
+    for(int face = 0; face < 6; ++face) {
+        for(std::size_t i = 0; i < ranges.size(); ++i) {
+            ranges[i].first[face] = first;
+            first += ranges[i].count[face];
+        }
+    }
+    std::vector<Vertex> joined(count);
+    for(std::size_t i = 0; i < ranges.size(); ++i) {
+        const std::vector<Vertex> &mesh = sectionMeshes[ranges[i].section];
+        std::size_t next[6];
+        std::copy(ranges[i].first, ranges[i].first + 6, next);
+        for(std::size_t v = 0; v < mesh.size(); v += 4) {
+            std::size_t &at = next[mesh[v].attrib & 7];
+            std::copy(mesh.begin() + v, mesh.begin() + v + 4, joined.begin() + at);
+            at += 4;
+        }
+    }
+
+    // the current buffer is drawn until the joined mesh replaces it
+    verts.swap(joined);
+    quads = count / 4;
+    uploadPending = true;
+}
+
+// Emits one quad on the plane d = plane covering [u0, u1] x [v0, v1] in corner coordinates,
+// where u and v are the other two axes: x -> (y, z), y -> (x, z), z -> (x, y).
+static void pushQuad(std::vector<Chunk::Vertex> &rVerts, int d, int dir, int plane,
+                     int u0, int u1, int v0, int v1, Chunk::BlockType block)
+{
+    const int u = d == 0 ? 1 : 0;
+    const int v = d == 2 ? 1 : 2;
+    const int us[4] = { u0, u1, u1, u0 };
+    const int vs[4] = { v0, v0, v1, v1 };
+    // going round u0 -> u1 -> v1 is counter-clockwise seen from +x, -y and +z (u x v
+    // points that way); the other faces go round the other way
+    const bool reverse = (d == 1 ? -dir : dir) < 0;
+    for(int k = 0; k < 4; ++k) {
+        const int c = reverse ? (4 - k) % 4 : k;
+        int p[3];
+        p[d] = plane;
+        p[u] = us[c];
+        p[v] = vs[c];
+        Chunk::Vertex vertex = { (quint8)p[0], (quint8)p[1], (quint8)p[2],
+                                 (quint8)(d * 2 + (dir > 0 ? 1 : 0) + (block << 3)) };
+        rVerts.push_back(vertex);
+    }
+}
+
+void Chunk::buildQuadsNaive(const Snapshot &s, int sx, int sy, int sz, std::vector<Vertex> &rVerts)
+{
+    const int n = Section::Size;
+    const int dy = s.width, dz = s.width * s.height;
+    const int section = sx + (sy + sz * sectionCount) * sectionCount;
+
+    // air sections have no faces, solid ones only on their outer shell
+    if(s.uniform[section] == 0) return;
+    const bool solid = s.uniform[section] > 0;
+
+    const int x0 = sx * n, y0 = sy * n, z0 = sz * n;
+    const int x1 = std::min(x0 + n, size), y1 = std::min(y0 + n, size), z1 = std::min(z0 + n, size);
+    const BlockType *b = &s.blocks[0];
+    for(int z = z0; z < z1; ++z)
     {
-        for(int y = 0; y < size; ++y)
+        for(int y = y0; y < y1; ++y)
         {
-            for(int z = -hs; z < hs; ++z)
+            const bool shellOnly = solid && z > z0 && z < z1 - 1 && y > y0 && y < y1 - 1;
+            for(int x = x0; x < x1; x += shellOnly && x == x0 ? std::max(1, x1 - x0 - 1) : 1)
             {
-                BlockType block = getBlock(x, y, z);
+                const int i = s.index(x, y, z);
+                BlockType block = b[i];
                 if(block) {
-                    if(!getBlock(x - 1, y, z)) {
+                    if(!b[i - 1]) {
                         //left
-                        push(rVerts, x - 0.5, y - 0.5, z - 0.5);
-                        push(rVerts, x - 0.5, y + 0.5, z - 0.5);
-                        push(rVerts, x - 0.5, y + 0.5, z + 0.5);
-                        push(rVerts, x - 0.5, y - 0.5, z + 0.5);
-
-                        push(rNormals, -1, 0, 0);
-                        push(rNormals, -1, 0, 0);
-                        push(rNormals, -1, 0, 0);
-                        push(rNormals, -1, 0, 0);
-                        rQuads++;
+                        pushQuad(rVerts, 0, -1, x, y, y + 1, z, z + 1, block);
                     }
-                    if(!getBlock(x + 1, y, z)) {
+                    if(!b[i + 1]) {
                         //right
-                        push(rVerts, x + 0.5, y - 0.5, z - 0.5);
-                        push(rVerts, x + 0.5, y + 0.5, z - 0.5);
-                        push(rVerts, x + 0.5, y + 0.5, z + 0.5);
-                        push(rVerts, x + 0.5, y - 0.5, z + 0.5);
-
-                        push(rNormals, 1, 0, 0);
-                        push(rNormals, 1, 0, 0);
-                        push(rNormals, 1, 0, 0);
-                        push(rNormals, 1, 0, 0);
-                        rQuads++;
+                        pushQuad(rVerts, 0, 1, x + 1, y, y + 1, z, z + 1, block);
                     }
-                    if(!getBlock(x, y, z - 1)) {
+                    if(!b[i - dz]) {
                         //forward
-                        push(rVerts, x - 0.5, y - 0.5, z - 0.5);
-                        push(rVerts, x + 0.5, y - 0.5, z - 0.5);
-                        push(rVerts, x + 0.5, y + 0.5, z - 0.5);
-                        push(rVerts, x - 0.5, y + 0.5, z - 0.5);
-
-                        push(rNormals, 0, 0, -1);
-                        push(rNormals, 0, 0, -1);
-                        push(rNormals, 0, 0, -1);
-                        push(rNormals, 0, 0, -1);
-                        rQuads++;
+                        pushQuad(rVerts, 2, -1, z, x, x + 1, y, y + 1, block);
                     }
-                    if(!getBlock(x, y, z + 1)) {
+                    if(!b[i + dz]) {
                         //back
-                        push(rVerts, x - 0.5, y - 0.5, z + 0.5);
-                        push(rVerts, x + 0.5, y - 0.5, z + 0.5);
-                        push(rVerts, x + 0.5, y + 0.5, z + 0.5);
-                        push(rVerts, x - 0.5, y + 0.5, z + 0.5);
-
-                        push(rNormals, 0, 0, 1);
-                        push(rNormals, 0, 0, 1);
-                        push(rNormals, 0, 0, 1);
-                        push(rNormals, 0, 0, 1);
-                        rQuads++;
+                        pushQuad(rVerts, 2, 1, z + 1, x, x + 1, y, y + 1, block);
                     }
-                    if(y > 0 && !getBlock(x, y - 1, z)) {
+                    if(y > 0 && !b[i - dy]) {
                         //up
-                        push(rVerts, x - 0.5, y - 0.5, z - 0.5);
-                        push(rVerts, x + 0.5, y - 0.5, z - 0.5);
-                        push(rVerts, x + 0.5, y - 0.5, z + 0.5);
-                        push(rVerts, x - 0.5, y - 0.5, z + 0.5);
-
-                        push(rNormals, 0, -1, 0);
-                        push(rNormals, 0, -1, 0);
-                        push(rNormals, 0, -1, 0);
-                        push(rNormals, 0, -1, 0);
-                        rQuads++;
+                        pushQuad(rVerts, 1, -1, y, x, x + 1, z, z + 1, block);
                     }
-                    if(y < size - 1 && !getBlock(x, y + 1, z)) {
+                    if(y < size - 1 && !b[i + dy]) {
                         //down
-                        push(rVerts, x - 0.5, y + 0.5, z - 0.5);
-                        push(rVerts, x + 0.5, y + 0.5, z - 0.5);
-                        push(rVerts, x + 0.5, y + 0.5, z + 0.5);
-                        push(rVerts, x - 0.5, y + 0.5, z + 0.5);
-
-                        push(rNormals, 0, 1, 0);
-                        push(rNormals, 0, 1, 0);
-                        push(rNormals, 0, 1, 0);
-                        push(rNormals, 0, 1, 0);
-                        rQuads++;
+                        pushQuad(rVerts, 1, 1, y + 1, x, x + 1, z, z + 1, block);
                     }
-                    sched_yield();
                 }
             }
         }
     }
+}
+
+void Chunk::buildQuadsGreedy(const Snapshot &s, int sx, int sy, int sz, std::vector<Vertex> &rVerts)
+{
+    const int n = Section::Size;
+    const int uniform = s.uniform[sx + (sy + sz * sectionCount) * sectionCount];
+    if(uniform == 0) return;
 
-    qDebug() << "Quads:" << rQuads << ", verts" << rVerts.size();
+    const int lo[3] = { sx * n, sy * n, sz * n };
+    const int hi[3] = { std::min(lo[0] + n, size), std::min(lo[1] + n, size), std::min(lo[2] + n, size) };
+    const int stride[3] = { 1, s.width, s.width * s.height };
+    const BlockType *b = &s.blocks[0];
+    BlockType mask[Section::Size * Section::Size];
+    int rowFaces[Section::Size];  // faces left in each row of the mask
 
-    {
-        verts = rVerts;
-        normals = rNormals;
-        quads = rQuads;
+    for(int d = 0; d < 3; ++d) {
+        const int u = d == 0 ? 1 : 0;
+        const int v = d == 2 ? 1 : 2;
+        const int w = hi[u] - lo[u], h = hi[v] - lo[v];
+        for(int dir = -1; dir <= 1; dir += 2) {
+            const int next = dir * stride[d];
+            for(int sl = lo[d]; sl < hi[d]; ++sl) {
+                // like the naive mesher, no faces on the bottom and top of the chunk
+                if(d == 1 && ((dir < 0 && sl == 0) || (dir > 0 && sl == size - 1)))
+                    continue;
+                // inside a solid section no face is exposed
+                if(uniform > 0 && sl + dir >= lo[d] && sl + dir < hi[d])
+                    continue;
+
+                // mask of exposed faces in this slice, by block type
+                int faces = 0;
+                for(int j = 0; j < h; ++j) {
+                    int p[3];
+                    p[d] = sl;
+                    p[u] = lo[u];
+                    p[v] = lo[v] + j;
+                    int i0 = s.index(p[0], p[1], p[2]);
+                    rowFaces[j] = 0;
+                    for(int i = 0; i < w; ++i, i0 += stride[u]) {
+                        BlockType block = b[i0];
+                        if(block && b[i0 + next])
+                            block = 0;
+                        mask[i + j * n] = block;
+                        if(block) ++rowFaces[j];
+                    }
+                    faces += rowFaces[j];
+                }
+
+                // grow each unvisited face along u, then along v while the whole row matches
+                for(int j = 0; j < h && faces; ++j) {
+                    for(int i = 0; i < w && rowFaces[j];) {
+                        const BlockType block = mask[i + j * n];
+                        if(!block) {
+                            ++i;
+                            continue;
+                        }
+                        int qw = 1;
+                        while(i + qw < w && mask[i + qw + j * n] == block)
+                            ++qw;
+                        int qh = 1;
+                        for(bool grow = true; grow && j + qh < h; ) {
+                            for(int k = 0; k < qw; ++k) {
+                                if(mask[i + k + (j + qh) * n] != block) {
+                                    grow = false;
+                                    break;
+                                }
+                            }
+                            if(grow) ++qh;
+                        }
+                        for(int l = 0; l < qh; ++l) {
+                            for(int k = 0; k < qw; ++k) {
+                                mask[i + k + (j + l) * n] = 0;
+                            }
+                            rowFaces[j + l] -= qw;
+                        }
+                        faces -= qw * qh;
+
+                        pushQuad(rVerts, d, dir, sl + (dir > 0 ? 1 : 0), lo[u] + i, lo[u] + i + qw, lo[v] + j, lo[v] + j + qh, block);
+                        i += qw;
+                    }
+                }
+            }
+        }
     }
+}
+
+void Chunk::downsample(const Snapshot &s, int scale, std::vector<BlockType> &cells)
+{
+    // each cell takes the commonest solid block type if at least half its blocks are
+    // solid; beyond the top and bottom of the chunk cells count as solid, like the
+    // full detail meshers that leave those faces out, and beyond its sides as air
+    const int count = size / scale, cw = count + 2;
+    const int half = scale * scale * scale / 2;
+    cells.assign(cw * cw * cw, 0);
+    for(int k = 0; k < cw; ++k) {
+        for(int j = 0; j < cw; ++j) {
+            for(int i = 0; i < cw; ++i) {
+                BlockType &cell = cells[i + (j + k * cw) * cw];
+                if(j == 0 || j == cw - 1) {
+                    cell = 1;
+                    continue;
+                }
+                if(i == 0 || i == cw - 1 || k == 0 || k == cw - 1) continue;
 
+                BlockType types[8];
+                int typeCounts[8], typesSeen = 0, solid = 0;
+                const int x0 = (i - 1) * scale, y0 = (j - 1) * scale, z0 = (k - 1) * scale;
+                for(int z = z0; z < z0 + scale; ++z) {
+                    for(int y = y0; y < y0 + scale; ++y) {
+                        for(int x = x0; x < x0 + scale; ++x) {
+                            const BlockType b = s.at(x, y, z);
+                            if(!b) continue;
+                            ++solid;
+                            int t = 0;
+                            while(t < typesSeen && types[t] != b) ++t;
+                            if(t == typesSeen && typesSeen < 8) {
+                                types[typesSeen] = b;
+                                typeCounts[typesSeen++] = 0;
+                            }
+                            if(t < typesSeen) ++typeCounts[t];
+                        }
+                    }
+                }
+                if(solid < half || !typesSeen) continue;
+                cell = types[std::max_element(typeCounts, typeCounts + typesSeen) - typeCounts];
+            }
+        }
+    }
 }
 
-void Chunk::copyDataToGPU()
+void Chunk::buildQuadsCoarse(const std::vector<BlockType> &cells, int scale, int sx, int sy, int sz,
+                             std::vector<Vertex> &rVerts)
 {
-    if(quads > 0 && (!vertexBuffer || !normalBuffer)) {
-        if(!vertexBuffer) glGenBuffers(1, &vertexBuffer);
-        if(!normalBuffer) glGenBuffers(1, &normalBuffer);
+    const int n = Section::Size / scale;
+    const int cw = size / scale + 2;
+    const int lo[3] = { sx * n, sy * n, sz * n };
+    const int hi[3] = { std::min(lo[0] + n, cw - 2), std::min(lo[1] + n, cw - 2), std::min(lo[2] + n, cw - 2) };
+    const int stride[3] = { 1, cw, cw * cw };
+    // the cell at (x, y, z) in cells; the border shifts them by one
+    const int origin = 1 + stride[1] + stride[2];
+    BlockType mask[Section::Size * Section::Size];
+
+    for(int d = 0; d < 3; ++d) {
+        const int u = d == 0 ? 1 : 0;
+        const int v = d == 2 ? 1 : 2;
+        const int w = hi[u] - lo[u], h = hi[v] - lo[v];
+        for(int dir = -1; dir <= 1; dir += 2) {
+            for(int sl = lo[d]; sl < hi[d]; ++sl) {
+                int faces = 0;
+                for(int j = 0; j < h; ++j) {
+                    for(int i = 0; i < w; ++i) {
+                        int p[3];
+                        p[d] = sl;
+                        p[u] = lo[u] + i;
+                        p[v] = lo[v] + j;
+                        const int c = origin + p[0] + p[1] * stride[1] + p[2] * stride[2];
+                        const BlockType block = cells[c] && !cells[c + dir * stride[d]] ? cells[c] : 0;
+                        mask[i + j * n] = block;
+                        if(block) ++faces;
+                    }
+                }
 
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(float), &verts[0], GL_DYNAMIC_DRAW);
+                // merged the same way as buildQuadsGreedy
+                for(int j = 0; j < h && faces; ++j) {
+                    for(int i = 0; i < w;) {
+                        const BlockType block = mask[i + j * n];
+                        if(!block) {
+                            ++i;
+                            continue;
+                        }
+                        int qw = 1;
+                        while(i + qw < w && mask[i + qw + j * n] == block)
+                            ++qw;
+                        int qh = 1;
+                        for(bool grow = true; grow && j + qh < h; ) {
+                            for(int k = 0; k < qw; ++k) {
+                                if(mask[i + k + (j + qh) * n] != block) {
+                                    grow = false;
+                                    break;
+                                }
+                            }
+                            if(grow) ++qh;
+                        }
+                        for(int l = 0; l < qh; ++l) {
+                            for(int k = 0; k < qw; ++k) {
+                                mask[i + k + (j + l) * n] = 0;
+                            }
+                        }
+                        faces -= qw * qh;
 
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), &normals[0], GL_DYNAMIC_DRAW);
+                        pushQuad(rVerts, d, dir, (sl + (dir > 0 ? 1 : 0)) * scale,
+                                 (lo[u] + i) * scale, (lo[u] + i + qw) * scale,
+                                 (lo[v] + j) * scale, (lo[v] + j + qh) * scale, block);
+                        i += qw;
+                    }
+                }
+            }
+        }
     }
 }
 
+bool Chunk::needsUpload() const
+{
+    return uploadPending || (quads && !allocation.count);
+}
+
+const std::vector<Chunk::Vertex> &Chunk::pendingVertices()
+{
+    // verts is dropped after each upload, so join the meshes again if the space was freed
+    if(verts.size() != quads * 4) joinSectionMeshes();
+    return verts;
+}
+
+void Chunk::uploaded(BufferArena &arena_, const BufferArena::Allocation &a)
+{
+    if(arena) arena->free(allocation);
+    arena = &arena_;
+    allocation = a;
+    drawnRanges.swap(ranges);
+    ranges.clear();
+
+    // the section meshes keep the CPU copy
+    std::vector<Vertex>().swap(verts);
+    uploadPending = false;
+}
+
 }
@@ -2,6 +2,9 @@
 #define CHUNK_H
 
 #include "drawable.h"
+#include "bufferarena.h"
+
+#include <QtGlobal>
 
 #include <boost/scoped_array.hpp>
 #include <boost/thread/mutex.hpp>
@@ -14,34 +17,171 @@ using boost::scoped_array;
 
 namespace Glube {
 
+class TerrainGenerator;
+class RegionStore;
+class Section;
+class DrawBatch;
+class BoxList;
+
 class Chunk
 {
 public:
     Chunk(int size);
     virtual ~Chunk();
 
-    virtual void draw();
+    // adds the last uploaded mesh to the batch, with offset added to its vertex positions,
+    // leaving out each section's faces that point away from eye; if visible is given it
+    // has a flag for each box sectionBoxes() added, and only the sections flagged are drawn
+    virtual void draw(DrawBatch &batch, const glm::vec3 &offset, const glm::vec3 &eye,
+                      const unsigned char *visible = 0);
+    // appends the bounds, moved by offset, of each section with faces in the uploaded
+    // mesh and returns how many there were
+    std::size_t sectionBoxes(BoxList &boxes, const glm::vec3 &offset) const;
+    // Sections' faces are numbered like Vertex face directions: -x, +x, -y, +y, -z, +z.
+    // True if air inside the section links faces a and b; sections not meshed yet are open.
+    bool facesConnected(int section, int a, int b) const;
+    // clears the flag of each sectionBoxes() box whose section wasn't visited in frame
+    void cullUnvisited(unsigned frame, unsigned char *visible) const;
+    // appends, moved by offset, a box for the top run of solid sections in each column
+    // of sections, to hide what's behind them; returns how many there were
+    std::size_t occluderBoxes(BoxList &boxes, const glm::vec3 &offset);
+    // gives the mesh's space in the arena back; it has to be uploaded again
     virtual void deleteBuffers();
 
     typedef unsigned char BlockType;
     virtual BlockType getBlock(int x, int y, int z);
+    // marks the sections the change can show in as stale; remeshStale() updates them
     virtual void setBlock(int x, int y, int z, BlockType value);
 
+    // Mesh vertex: corner position in voxel corners from meshOrigin(), so chunk
+    // sizes up to 255 fit in a byte, plus the face direction (-x, +x, -y, +y, -z, +z)
+    // in the low three bits of attrib and the block type in the high five. Quads
+    // wind counter-clockwise seen from the side they face.
+    struct Vertex {
+        quint8 x, y, z;
+        quint8 attrib;
+    };
+    glm::vec3 meshOrigin() const;
+
+    // Uploads go through an UploadQueue: if needsUpload(), the queue writes
+    // pendingVertices() to the arena and passes the new space to uploaded().
+    bool needsUpload() const;
+    const std::vector<Vertex> &pendingVertices();
+    void uploaded(BufferArena &arena, const BufferArena::Allocation &a);
+
+    enum MeshMode {
+        NaiveMesh,  // one quad per exposed voxel face
+        GreedyMesh  // coplanar faces of the same block type merged into rectangles
+    };
+    void setMeshMode(MeshMode mode);
+    // blocks per mesh cell along each axis: 1 for full detail, or 2, 4 or 8 for meshes
+    // of downsampled block data
+    int getMeshScale() const;
+
+    std::size_t quadCount() const;
+    // bytes of block data and CPU side mesh held by the chunk
+    std::size_t memoryUsage() const;
+
 protected:
-    void assignRandom(long ix, long iy, long iz);
-    void buildQuads();
+    // loads the block data from store if it has this chunk, otherwise generates it;
+    // generated chunks are only written to store once edited, see save()
+    void assignRandom(const TerrainGenerator &generator, long ix, long iy, long iz, RegionStore *store = 0);
+    // writes the block data back to store if setBlock changed it since it was loaded or saved
+    void save(RegionStore *store, long ix, long iz);
+    // meshes every section at scale, see getMeshScale()
+    void buildQuads(int scale = 1);
+    bool hasStaleSections();
+    // Meshes up to maxSections (0 = all) of the stale sections again; returns false if
+    // there were none. Only full detail meshes are remeshed by section: downsampled
+    // cells span sections, so those are built again whole with buildMeshes().
+    bool remeshStale(std::size_t maxSections = 0);
+    // Meshes every section at scale into meshes, and their connectivity into connections,
+    // without touching the chunk's own, so it can run while the current meshes are drawn;
+    // setMeshes() swaps them in afterwards. Downsampled meshes treat everything beyond
+    // the chunk's x and z edges as air, so their border walls cover any gap to
+    // neighbours meshed at another scale.
+    void buildMeshes(int scale, std::vector<std::vector<Vertex> > &meshes, std::vector<unsigned short> &connections);
+    void setMeshes(std::vector<std::vector<Vertex> > &meshes, std::vector<unsigned short> &connections, int scale);
+    // marks the section holding (x, y, z) as stale
+    void markStale(int x, int y, int z);
     int size;
+    int sectionCount;  // per axis
+    // the last frame a visibility search reached each section; see cullUnvisited()
+    std::vector<unsigned> visitedFrame;
+
+    // A box of block data copied out of the chunk and its x and z neighbours, so the
+    // mesher needs no locks or virtual calls. Coordinates are corner coordinates, 0 to
+    // size - 1 inside the chunk; blocks outside the chunk are those of the neighbours.
+    struct Snapshot {
+        int x0, y0, z0;  // first block held
+        int width, height, depth;
+        std::vector<BlockType> blocks;
+        std::vector<int> uniform;  // per section of the chunk, its block type if uniform, otherwise -1
+
+        int index(int x, int y, int z) const { return (x - x0) + ((y - y0) + (z - z0) * height) * width; }
+        BlockType at(int x, int y, int z) const { return blocks[index(x, y, z)]; }
+    };
+    // copies the sections [sx0, sx1) x [sy0, sy1) x [sz0, sz1) with a one block border,
+    // and clears their stale flags; the border outside the chunk is air unless
+    // snapshotApron fills it
+    void snapshot(Snapshot &s, int sx0, int sx1, int sy0, int sy1, int sz0, int sz1);
+    virtual void snapshotApron(Snapshot &s);
+    // copies the blocks of this chunk that fall inside s, offset by (dx, dz)
+    void copyInto(Snapshot &s, int dx, int dz);
 
 private:
 
-    void copyDataToGPU();
+    // block data is split into Section::Size^3 sections, sectionCount per axis
+    Section &sectionAt(int x, int y, int z);
+    // all block data to and from the dense layout TerrainGenerator and RegionStore
+    // use, (x + size/2) + y * size + (z + size/2) * size * size; callers lock
+    void packBlocks(const BlockType *blocks);
+    void unpackBlocks(BlockType *blocks, int yStride, int zStride);
+    // copyInto without locking
+    void copyBlocks(Snapshot &s, int dx, int dz);
+    void markStaleLocked(int x, int y, int z);
+
+    // mesh the section (sx, sy, sz) of s; greedy quads do not cross section borders
+    void buildQuadsNaive(const Snapshot &s, int sx, int sy, int sz, std::vector<Vertex> &rVerts);
+    void buildQuadsGreedy(const Snapshot &s, int sx, int sy, int sz, std::vector<Vertex> &rVerts);
+    // mesh the section (sx, sy, sz) from cells, the chunk downsampled by scale with a
+    // border of one cell; see downsample()
+    void buildQuadsCoarse(const std::vector<BlockType> &cells, int scale, int sx, int sy, int sz,
+                          std::vector<Vertex> &rVerts);
+    void downsample(const Snapshot &s, int scale, std::vector<BlockType> &cells);
+    // meshes every section of s into meshes at scale, and their connectivity if asked
+    void meshSections(const Snapshot &s, int scale, std::vector<std::vector<Vertex> > &meshes,
+                      std::vector<unsigned short> *connections);
+    // which pairs of the section's faces air connects, a bit for each; see facesConnected()
+    unsigned short connectivityOf(const Snapshot &s, int sx, int sy, int sz) const;
+    // joins the section meshes into verts for the next upload
+    void joinSectionMeshes();
 
     boost::mutex m_mutex;
-    scoped_array<BlockType> blockData;
+    boost::mutex m_assignMutex;  // held by assignRandom, so a chunk is generated once
+    scoped_array<Section> sections;
     bool blockDataReady;
+    bool dirty;
+    MeshMode meshMode;
+    int meshScale;
+
+    std::vector<bool> staleSections;
+    std::vector<std::vector<Vertex> > sectionMeshes;
+    std::vector<unsigned short> connectivity;
+
+    // the vertices of one section within the joined mesh, which holds every
+    // section's faces of one direction before those of the next
+    struct MeshRange {
+        std::size_t first[6], count[6];  // by face direction
+        int section;
+    };
 
-    GLuint vertexBuffer, normalBuffer;
-    std::vector<float> verts, normals;
+    BufferArena *arena;
+    BufferArena::Allocation allocation;
+    std::vector<Vertex> verts;  // waiting for upload, dropped once uploaded
+    std::vector<MeshRange> ranges;       // the sections in verts
+    std::vector<MeshRange> drawnRanges;  // the sections in allocation
+    bool uploadPending;
     std::size_t quads;
 
 };
@@ -0,0 +1,267 @@
+#ifndef CONCURRENTMAP_H
+#define CONCURRENTMAP_H
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <vector>
+
+namespace Glube {
+
+// Hash map from 64 bit keys to shared_ptr<T> for many readers and few writers.
+// find() takes no lock: buckets are chains of atomically linked entries, and an
+// entry is never changed once published. Changes go through a Writer, which holds
+// the write lock. Entries unlinked by erase() or left behind by growing the table
+// are retired, and only freed once no find() is in progress.
+template<class T>
+class ConcurrentMap: boost::noncopyable
+{
+public:
+    typedef boost::uint64_t Key;
+
+    ConcurrentMap();
+    ~ConcurrentMap();
+
+    // an empty pointer if key is absent
+    boost::shared_ptr<T> find(Key key) const;
+    std::size_t size() const;
+
+    class Writer;
+
+private:
+    struct Entry {
+        Entry(Key k, const boost::shared_ptr<T> &v, Entry *n): key(k), value(v), next(n) {}
+        const Key key;
+        const boost::shared_ptr<T> value;
+        boost::atomic<Entry*> next;
+    };
+
+    struct Table {
+        explicit Table(std::size_t buckets): mask(buckets - 1), heads(new boost::atomic<Entry*>[buckets])
+        {
+            for(std::size_t i = 0; i < buckets; ++i) heads[i] = 0;
+        }
+        const std::size_t mask;
+        boost::scoped_array<boost::atomic<Entry*> > heads;
+    };
+
+    static std::size_t hash(Key key)
+    {
+        key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+        return static_cast<std::size_t>(key ^ (key >> 31));
+    }
+
+    // frees retired entries and tables once no reader can still see them; needs the write lock
+    void reclaim();
+
+    boost::mutex m_writeMutex;
+    boost::atomic<Table*> table;
+    mutable boost::atomic<unsigned> readers;
+    boost::atomic<std::size_t> count;
+    std::vector<Entry*> retiredEntries;
+    std::vector<Table*> retiredTables;
+};
+
+// Holds the write lock for its lifetime. find() here sees the map as it is, and
+// the iteration methods visit every entry once.
+template<class T>
+class ConcurrentMap<T>::Writer: boost::noncopyable
+{
+public:
+    explicit Writer(ConcurrentMap &map);
+    ~Writer();
+
+    boost::shared_ptr<T> find(Key key) const;
+    // adds key unless it is present; returns the value now stored for it
+    boost::shared_ptr<T> insert(Key key, const boost::shared_ptr<T> &value);
+    bool erase(Key key);
+    // waits for lookups in progress to finish, then frees everything retired so far;
+    // after this no reference to an erased value is left in the map
+    void synchronize();
+
+    // iteration: for(Entry *e = w.first(); e; e = w.next(e))
+    typedef typename ConcurrentMap::Entry Entry;
+    Entry *first() const;
+    Entry *next(Entry *e) const;
+
+private:
+    Entry *firstFrom(std::size_t bucket) const;
+    void grow();
+
+    ConcurrentMap &map;
+    boost::mutex::scoped_lock lock;
+};
+
+template<class T>
+ConcurrentMap<T>::ConcurrentMap():
+    table(new Table(64)),
+    readers(0),
+    count(0)
+{
+}
+
+template<class T>
+ConcurrentMap<T>::~ConcurrentMap()
+{
+    Table *t = table;
+    for(std::size_t i = 0; i <= t->mask; ++i) {
+        for(Entry *e = t->heads[i]; e; ) {
+            Entry *next = e->next;
+            delete e;
+            e = next;
+        }
+    }
+    delete t;
+    reclaim();
+}
+
+template<class T>
+boost::shared_ptr<T> ConcurrentMap<T>::find(Key key) const
+{
+    // the count keeps retired entries alive until this lookup is done
+    ++readers;
+    const Table *t = table;
+    boost::shared_ptr<T> value;
+    for(const Entry *e = t->heads[hash(key) & t->mask]; e; e = e->next) {
+        if(e->key == key) {
+            value = e->value;
+            break;
+        }
+    }
+    --readers;
+    return value;
+}
+
+template<class T>
+std::size_t ConcurrentMap<T>::size() const
+{
+    return count;
+}
+
+template<class T>
+void ConcurrentMap<T>::reclaim()
+{
+    if(readers != 0) return;
+    for(std::size_t i = 0; i < retiredEntries.size(); ++i) {
+        delete retiredEntries[i];
+    }
+    for(std::size_t i = 0; i < retiredTables.size(); ++i) {
+        delete retiredTables[i];
+    }
+    retiredEntries.clear();
+    retiredTables.clear();
+}
+
+template<class T>
+ConcurrentMap<T>::Writer::Writer(ConcurrentMap &map_):
+    map(map_),
+    lock(map_.m_writeMutex)
+{
+}
+
+template<class T>
+ConcurrentMap<T>::Writer::~Writer()
+{
+    map.reclaim();
+}
+
+template<class T>
+boost::shared_ptr<T> ConcurrentMap<T>::Writer::find(Key key) const
+{
+    const Table *t = map.table;
+    for(const Entry *e = t->heads[hash(key) & t->mask]; e; e = e->next) {
+        if(e->key == key) return e->value;
+    }
+    return boost::shared_ptr<T>();
+}
+
+template<class T>
+boost::shared_ptr<T> ConcurrentMap<T>::Writer::insert(Key key, const boost::shared_ptr<T> &value)
+{
+    boost::shared_ptr<T> existing = find(key);
+    if(existing) return existing;
+
+    if(map.count + 1 > (map.table.load()->mask + 1) * 2) grow();
+    Table *t = map.table;
+    boost::atomic<Entry*> &head = t->heads[hash(key) & t->mask];
+    // fully built before it is published, so readers never see a partial entry
+    head = new Entry(key, value, head);
+    ++map.count;
+    return value;
+}
+
+template<class T>
+bool ConcurrentMap<T>::Writer::erase(Key key)
+{
+    Table *t = map.table;
+    boost::atomic<Entry*> *link = &t->heads[hash(key) & t->mask];
+    for(Entry *e = *link; e; e = *link) {
+        if(e->key == key) {
+            // readers standing on e still find the rest of the chain through e->next
+            *link = e->next.load();
+            map.retiredEntries.push_back(e);
+            --map.count;
+            return true;
+        }
+        link = &e->next;
+    }
+    return false;
+}
+
+template<class T>
+void ConcurrentMap<T>::Writer::synchronize()
+{
+    while(map.readers != 0) {
+        boost::this_thread::yield();
+    }
+    map.reclaim();
+}
+
+template<class T>
+typename ConcurrentMap<T>::Writer::Entry *ConcurrentMap<T>::Writer::first() const
+{
+    return firstFrom(0);
+}
+
+template<class T>
+typename ConcurrentMap<T>::Writer::Entry *ConcurrentMap<T>::Writer::next(Entry *e) const
+{
+    if(e->next) return e->next;
+    return firstFrom((hash(e->key) & map.table.load()->mask) + 1);
+}
+
+template<class T>
+typename ConcurrentMap<T>::Writer::Entry *ConcurrentMap<T>::Writer::firstFrom(std::size_t bucket) const
+{
+    const Table *t = map.table;
+    for(; bucket <= t->mask; ++bucket) {
+        if(t->heads[bucket]) return t->heads[bucket];
+    }
+    return 0;
+}
+
+template<class T>
+void ConcurrentMap<T>::Writer::grow()
+{
+    // readers may be walking the old chains, so copy the entries instead of relinking them
+    Table *old = map.table;
+    Table *t = new Table((old->mask + 1) * 2);
+    for(std::size_t i = 0; i <= old->mask; ++i) {
+        for(Entry *e = old->heads[i]; e; e = e->next) {
+            boost::atomic<Entry*> &head = t->heads[hash(e->key) & t->mask];
+            head = new Entry(e->key, e->value, head);
+            map.retiredEntries.push_back(e);
+        }
+    }
+    map.table = t;
+    map.retiredTables.push_back(old);
+}
+
+}
+#endif // CONCURRENTMAP_H
@@ -0,0 +1,41 @@
+# Chunk generation, meshing and storage, shared by the app and the benchmarks.
+# Needs QtCore only; what talks to GL is in glube.pro.
+
+QT += core
+
+INCLUDEPATH += $$PWD /usr/local/include
+
+LIBS += -L/usr/local/lib -lboost_thread -lboost_atomic -lboost_system
+
+SOURCES += $$PWD/chunk.cpp \
+    $$PWD/drawable.cpp \
+    $$PWD/mapnode.cpp \
+    $$PWD/simplex.c \
+    $$PWD/jobpool.cpp \
+    $$PWD/terrain.cpp \
+    $$PWD/region.cpp \
+    $$PWD/section.cpp \
+    $$PWD/bufferarena.cpp \
+    $$PWD/drawbatch.cpp \
+    $$PWD/uploadqueue.cpp \
+    $$PWD/frustum.cpp \
+    $$PWD/occlusion.cpp \
+    $$PWD/profiler.cpp \
+    $$PWD/nodegrid.cpp
+
+HEADERS += $$PWD/chunk.h \
+    $$PWD/drawable.h \
+    $$PWD/mapnode.h \
+    $$PWD/simplex.h \
+    $$PWD/jobpool.h \
+    $$PWD/terrain.h \
+    $$PWD/region.h \
+    $$PWD/section.h \
+    $$PWD/concurrentmap.h \
+    $$PWD/bufferarena.h \
+    $$PWD/drawbatch.h \
+    $$PWD/uploadqueue.h \
+    $$PWD/frustum.h \
+    $$PWD/occlusion.h \
+    $$PWD/profiler.h \
+    $$PWD/nodegrid.h
@@ -1,8 +1,5 @@
 #include "drawable.h"
 
-#include <glm/gtc/type_ptr.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-
 namespace Glube {
 
 Drawable::Drawable()
@@ -19,13 +16,6 @@ Drawable::~Drawable()
 {
 }
 
-void Drawable::draw(QGLShaderProgram &shaderProg, const glm::mat4 &parentModelMatrix)
-{
-    glm::mat4 modelMatrix = glm::translate(parentModelMatrix, position);
-    int mLoc = shaderProg.uniformLocation("modelMatrix");
-    glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-}
-
 glm::vec3 Drawable::pos() const
 {
     return position;
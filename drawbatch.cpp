@@ -0,0 +1,63 @@
+#include "drawbatch.h"
+
+#include <algorithm>
+
+namespace Glube {
+
+DrawBatch::DrawBatch():
+    commands(),
+    offsets(),
+    maxQuads(0),
+    totalQuads(0)
+{
+}
+
+DrawBatch::~DrawBatch()
+{
+}
+
+void DrawBatch::clear()
+{
+    commands.clear();
+    offsets.clear();
+    maxQuads = 0;
+    totalQuads = 0;
+}
+
+void DrawBatch::add(const BufferArena::Allocation &a, const glm::vec3 &offset)
+{
+    const std::size_t quads = a.count / 4;
+    if(!quads) return;
+    Command c = { (boost::uint32_t)(quads * 6), 1, 0, (boost::int32_t)a.first, (boost::uint32_t)commands.size() };
+    commands.push_back(c);
+    offsets.push_back(offset);
+    maxQuads = std::max(maxQuads, quads);
+    totalQuads += quads;
+}
+
+std::size_t DrawBatch::size() const
+{
+    return commands.size();
+}
+
+const std::vector<DrawBatch::Command> &DrawBatch::getCommands() const
+{
+    return commands;
+}
+
+const std::vector<glm::vec3> &DrawBatch::getOffsets() const
+{
+    return offsets;
+}
+
+std::size_t DrawBatch::getMaxQuads() const
+{
+    return maxQuads;
+}
+
+std::size_t DrawBatch::getTotalQuads() const
+{
+    return totalQuads;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+#include "bufferarena.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <boost/cstdint.hpp>
+
+#include <vector>
+
+namespace Glube {
+
+// The meshes drawn in a frame, as ranges of a BufferArena. Meshes are quads, four
+// vertices each; every range becomes one indexed draw of its quads with its base
+// vertex at the start of the allocation, and carries an offset added to its vertex
+// positions. The commands are laid out as GL's DrawElementsIndirectCommand, with
+// each draw's base instance picking its offset; BatchRenderer draws them.
+class DrawBatch
+{
+public:
+    struct Command {
+        boost::uint32_t count;  // indices, 6 per quad
+        boost::uint32_t instanceCount;
+        boost::uint32_t firstIndex;
+        boost::int32_t baseVertex;
+        boost::uint32_t baseInstance;
+    };
+
+    DrawBatch();
+    virtual ~DrawBatch();
+
+    void clear();
+    void add(const BufferArena::Allocation &a, const glm::vec3 &offset);
+    std::size_t size() const;
+
+    const std::vector<Command> &getCommands() const;
+    const std::vector<glm::vec3> &getOffsets() const;
+    std::size_t getMaxQuads() const;  // in any one command
+    std::size_t getTotalQuads() const;
+
+private:
+    std::vector<Command> commands;
+    std::vector<glm::vec3> offsets;
+    std::size_t maxQuads;
+    std::size_t totalQuads;
+};
+
+}
+
+#endif // DRAWBATCH_H
@@ -1,4 +1,4 @@
-#version 120
+#version 330 core
 
 uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
@@ -9,8 +9,10 @@ uniform float clock;
 uniform float RenderDistance;
 uniform float FogStart;
 
-varying vec3 position;
-varying vec3 norm;
+in vec3 position;
+in vec3 norm;
+
+out vec4 fragColor;
 
 struct SHC{
     vec3 L00, L1m1, L10, L11, L2m2, L2m1, L20, L21, L22;
@@ -82,7 +84,7 @@ void main(){
     vec4 worldPos = modelMatrix * vec4(position, 1);
     float distance = length(worldPos.xyz - eyePosition);
 /*
-    gl_FragColor = vec4(0, 0, 1.0, 1);
+    fragColor = vec4(0, 0, 1.0, 1);
 
     float fog_start = 150, fog_end = 200;
     float dsq = distance * distance;
@@ -91,15 +93,15 @@ void main(){
             dsq = fog_end * fog_end;
             //discard;
         float g = (dsq - fog_start * fog_start) / (fog_end * fog_end - fog_start * fog_start);
-        gl_FragColor = vec4((1 - g) * vec3(0.5, 1.0, 0.5), 1.0) + vec4(g * vec3(135/255.0, 196/255.0, 250/255.0) * clock, 0.0);
-        //gl_FragColor *= 0;
+        fragColor = vec4((1 - g) * vec3(0.5, 1.0, 0.5), 1.0) + vec4(g * vec3(135/255.0, 196/255.0, 250/255.0) * clock, 0.0);
+        //fragColor *= 0;
     }
 */
 
-    gl_FragColor = vec4(sh_light(norm, beach) * 0.5, 1.0);
-    //gl_FragColor = vec4(sh_light(vec3(0,0,1), beach) * 0.5, 1.0);
-    //gl_FragColor = vec4(norm, 1.0);
-    //gl_FragColor = vec4(1, 1, 0, 1.0);
+    fragColor = vec4(sh_light(norm, beach) * 0.5, 1.0);
+    //fragColor = vec4(sh_light(vec3(0,0,1), beach) * 0.5, 1.0);
+    //fragColor = vec4(norm, 1.0);
+    //fragColor = vec4(1, 1, 0, 1.0);
 
     float fog_start = FogStart, fog_end = RenderDistance;
     if(distance > fog_start) {
@@ -107,8 +109,8 @@ void main(){
             distance = fog_end;
             //discard;
         float g = (distance - fog_start) / (fog_end - fog_start);
-        gl_FragColor = vec4((1 - g) * vec3(gl_FragColor.xyz), 1.0) + vec4(g * vec3(135/255.0, 196/255.0, 250/255.0) * clock, 0.0);
-        //gl_FragColor *= 0;
+        fragColor = vec4((1 - g) * vec3(fragColor.xyz), 1.0) + vec4(g * vec3(135/255.0, 196/255.0, 250/255.0) * clock, 0.0);
+        //fragColor *= 0;
     }
 }
 
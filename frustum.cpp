@@ -0,0 +1,102 @@
+#include "frustum.h"
+
+#if defined(__SSE__) || defined(__x86_64__)
+#define FRUSTUM_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace Glube {
+
+void BoxList::clear()
+{
+    minX.clear(); minY.clear(); minZ.clear();
+    maxX.clear(); maxY.clear(); maxZ.clear();
+}
+
+void BoxList::add(const glm::vec3 &min, const glm::vec3 &max)
+{
+    minX.push_back(min.x); minY.push_back(min.y); minZ.push_back(min.z);
+    maxX.push_back(max.x); maxY.push_back(max.y); maxZ.push_back(max.z);
+}
+
+std::size_t BoxList::size() const
+{
+    return minX.size();
+}
+
+Frustum::Frustum()
+{
+    set(glm::mat4(1.0f));
+}
+
+Frustum::Frustum(const glm::mat4 &viewProjection)
+{
+    set(viewProjection);
+}
+
+void Frustum::set(const glm::mat4 &m)
+{
+    // rows of the matrix; glm indexes columns first
+    glm::vec4 row[4];
+    for(int i = 0; i < 4; ++i) {
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+    // left, right, bottom, top, near, far
+    for(int i = 0; i < 3; ++i) {
+        planes[i * 2] = row[3] + row[i];
+        planes[i * 2 + 1] = row[3] - row[i];
+    }
+    for(int i = 0; i < 6; ++i) {
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+}
+
+bool Frustum::intersects(const glm::vec3 &min, const glm::vec3 &max) const
+{
+    for(int i = 0; i < 6; ++i) {
+        const glm::vec4 &p = planes[i];
+        // the corner furthest along the plane's normal
+        glm::vec3 c(p.x >= 0 ? max.x : min.x, p.y >= 0 ? max.y : min.y, p.z >= 0 ? max.z : min.z);
+        if(glm::dot(glm::vec3(p), c) + p.w < 0) return false;
+    }
+    return true;
+}
+
+void Frustum::cull(const BoxList &boxes, std::vector<unsigned char> &visible) const
+{
+    const std::size_t count = boxes.size();
+    visible.resize(count);
+    if(!count) return;
+    std::size_t i = 0;
+#ifdef FRUSTUM_SSE
+    // the furthest corner depends only on the plane, so each plane picks whole
+    // arrays and the test is four multiply-adds per box
+    const float *corner[6][3];
+    for(int p = 0; p < 6; ++p) {
+        corner[p][0] = planes[p].x >= 0 ? &boxes.maxX[0] : &boxes.minX[0];
+        corner[p][1] = planes[p].y >= 0 ? &boxes.maxY[0] : &boxes.minY[0];
+        corner[p][2] = planes[p].z >= 0 ? &boxes.maxZ[0] : &boxes.minZ[0];
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for(; i + 4 <= count; i += 4) {
+        __m128 outside = zero;
+        for(int p = 0; p < 6; ++p) {
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].x), _mm_loadu_ps(corner[p][0] + i)),
+                                  _mm_mul_ps(_mm_set1_ps(planes[p].y), _mm_loadu_ps(corner[p][1] + i)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p].z), _mm_loadu_ps(corner[p][2] + i)));
+            d = _mm_add_ps(d, _mm_set1_ps(planes[p].w));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, zero));
+        }
+        const int mask = _mm_movemask_ps(outside);
+        for(int j = 0; j < 4; ++j) {
+            visible[i + j] = !(mask & (1 << j));
+        }
+    }
+#endif
+    for(; i < count; ++i) {
+        visible[i] = intersects(glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]),
+                                glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]));
+    }
+}
+
+}
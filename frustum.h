@@ -0,0 +1,43 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace Glube {
+
+// Axis aligned boxes stored as separate arrays of each coordinate, so they can be
+// tested four at a time.
+class BoxList
+{
+public:
+    void clear();
+    void add(const glm::vec3 &min, const glm::vec3 &max);
+    std::size_t size() const;
+
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+};
+
+// The six planes of a projection * view matrix, pointing inwards.
+class Frustum
+{
+public:
+    Frustum();
+    explicit Frustum(const glm::mat4 &viewProjection);
+
+    void set(const glm::mat4 &viewProjection);
+    // true unless the box is entirely outside one of the planes; boxes crossing a
+    // corner of the frustum can pass without being visible
+    bool intersects(const glm::vec3 &min, const glm::vec3 &max) const;
+    // visible[i] is set to 1 if box i intersects the frustum, 0 if not
+    void cull(const BoxList &boxes, std::vector<unsigned char> &visible) const;
+
+private:
+    glm::vec4 planes[6];
+};
+
+}
+
+#endif // FRUSTUM_H
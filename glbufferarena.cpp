@@ -0,0 +1,42 @@
+#include "glbufferarena.h"
+
+namespace Glube {
+
+GLBufferArena::GLBufferArena(std::size_t elementSize_, std::size_t initialElements):
+    BufferArena(elementSize_, initialElements),
+    bufferId(0)
+{
+}
+
+GLBufferArena::~GLBufferArena()
+{
+    if(bufferId && glIsBuffer(bufferId)) glDeleteBuffers(1, &bufferId);
+}
+
+void GLBufferArena::write(const Allocation &a, const void *data)
+{
+    if(!a.count) return;
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+    glBufferSubData(GL_ARRAY_BUFFER, a.first * elementSize(), a.count * elementSize(), data);
+}
+
+GLuint GLBufferArena::buffer() const
+{
+    return bufferId;
+}
+
+void GLBufferArena::resize(std::size_t oldElements, std::size_t newElements)
+{
+    GLuint newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newElements * elementSize(), 0, GL_DYNAMIC_DRAW);
+    if(bufferId) {
+        glBindBuffer(GL_COPY_READ_BUFFER, bufferId);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldElements * elementSize());
+        glDeleteBuffers(1, &bufferId);
+    }
+    bufferId = newBuffer;
+}
+
+}
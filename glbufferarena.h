@@ -0,0 +1,32 @@
+#ifndef GLBUFFERARENA_H
+#define GLBUFFERARENA_H
+
+#include "bufferarena.h"
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <QtOpenGL>
+
+namespace Glube {
+
+// A BufferArena kept in one GL_ARRAY_BUFFER. Growing replaces the buffer with a
+// bigger one, copying its contents on the GPU, so allocate() and write() need the
+// GL context; free() does not.
+class GLBufferArena : public BufferArena
+{
+public:
+    GLBufferArena(std::size_t elementSize, std::size_t initialElements);
+    virtual ~GLBufferArena();
+
+    void write(const Allocation &a, const void *data);
+    GLuint buffer() const;
+
+protected:
+    virtual void resize(std::size_t oldElements, std::size_t newElements);
+
+private:
+    GLuint bufferId;
+};
+
+}
+
+#endif // GLBUFFERARENA_H
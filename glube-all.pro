@@ -0,0 +1,8 @@
+# Builds the app and the headless benchmarks.
+
+TEMPLATE = subdirs
+
+SUBDIRS = app bench
+
+app.file = glube.pro
+bench.file = bench/bench.pro
@@ -12,34 +12,36 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = glube
 TEMPLATE = app
 
-INCLUDEPATH += /usr/local/include
-
-LIBS += -L/usr/local/lib -lboost_thread -lboost_atomic -lboost_system
+include(core.pri)
 
 SOURCES += main.cpp \
     mainwindow.cpp \
     widget.cpp \
-    chunk.cpp \
-    drawable.cpp \
-    mapnode.cpp \
+    overlay.cpp \
+    camera.cpp \
+    glbufferarena.cpp \
+    batchrenderer.cpp \
+    gluploadqueue.cpp \
     vao.cpp \
-    simplex.c \
-    camera.cpp
+    gputimer.cpp
 
 HEADERS  += mainwindow.h \
     widget.h \
-    chunk.h \
-    drawable.h \
-    mapnode.h \
+    overlay.h \
+    camera.h \
+    glbufferarena.h \
+    batchrenderer.h \
+    gluploadqueue.h \
     vao.h \
-    simplex.h \
-    camera.h
+    gputimer.h
 
 FORMS    += mainwindow.ui
 
 OTHER_FILES += \
     vertex.shader \
-    fragment.shader
+    fragment.shader \
+    overlay-vertex.shader \
+    overlay-fragment.shader
 
 RESOURCES += \
     res.qrc
@@ -0,0 +1,111 @@
+#include "gluploadqueue.h"
+#include "chunk.h"
+#include "profiler.h"
+
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+
+namespace Glube {
+
+GLUploadQueue::GLUploadQueue(GLBufferArena &arena_):
+    UploadQueue(),
+    arena(arena_),
+    stagingBuffer(0),
+    stagingSize(0)
+{
+}
+
+GLUploadQueue::~GLUploadQueue()
+{
+    if(stagingBuffer && glIsBuffer(stagingBuffer)) glDeleteBuffers(1, &stagingBuffer);
+}
+
+std::size_t GLUploadQueue::drain()
+{
+    if(requests.empty()) return 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    std::sort(requests.begin(), requests.end());
+
+    // choose the meshes that fit in the budget and find space for them; the arena
+    // may grow here, which has to happen before anything is copied into it
+    const std::size_t elementSize = arena.elementSize();
+    std::vector<BufferArena::Allocation> allocations;
+    std::size_t bytes = 0;
+    std::vector<Request>::const_iterator i;
+    for(i = requests.begin(); i != requests.end(); ++i) {
+        const std::vector<Chunk::Vertex> &v = i->chunk->pendingVertices();
+        const std::size_t size = v.size() * elementSize;
+        if(!allocations.empty()
+           && ((budgetBytes && bytes + size > budgetBytes)
+               || (budgetMs && timer.nsecsElapsed() / 1e6 > budgetMs)))
+            break;
+        allocations.push_back(arena.allocate(v.size()));
+        bytes += size;
+    }
+
+    // the time budget is checked again before each mesh is copied, always copying
+    // at least one; allocations past the last mesh copied are handed back
+    std::size_t copied = 0;
+    if(bytes) {
+        // orphan the staging buffer so the driver can hand back fresh storage
+        // instead of waiting for last frame's copies to finish
+        if(!stagingBuffer) glGenBuffers(1, &stagingBuffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffer);
+        stagingSize = std::max(stagingSize, bytes);
+        glBufferData(GL_COPY_READ_BUFFER, stagingSize, 0, GL_STREAM_DRAW);
+        char *staging = (char *)glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes,
+                                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(staging) {
+            std::size_t offset = 0;
+            for(; copied < allocations.size(); ++copied) {
+                if(copied && budgetMs && timer.nsecsElapsed() / 1e6 > budgetMs) break;
+                const std::vector<Chunk::Vertex> &v = requests[copied].chunk->pendingVertices();
+                if(!v.empty()) std::memcpy(staging + offset, &v[0], v.size() * elementSize);
+                offset += allocations[copied].count * elementSize;
+            }
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+            glBindBuffer(GL_COPY_WRITE_BUFFER, arena.buffer());
+            offset = 0;
+            for(std::size_t n = 0; n < copied; ++n) {
+                if(allocations[n].count)
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                        offset, allocations[n].first * elementSize,
+                                        allocations[n].count * elementSize);
+                offset += allocations[n].count * elementSize;
+            }
+        } else {
+            qDebug() << "Couldn't map the upload staging buffer, writing meshes directly";
+            for(; copied < allocations.size(); ++copied) {
+                if(copied && budgetMs && timer.nsecsElapsed() / 1e6 > budgetMs) break;
+                const std::vector<Chunk::Vertex> &v = requests[copied].chunk->pendingVertices();
+                if(!v.empty()) arena.write(allocations[copied], &v[0]);
+            }
+        }
+    } else {
+        // nothing but empty meshes
+        copied = allocations.size();
+    }
+    for(std::size_t n = copied; n < allocations.size(); ++n) {
+        bytes -= allocations[n].count * elementSize;
+        arena.free(allocations[n]);
+    }
+    allocations.resize(copied);
+
+    // the old meshes are freed as the new ones take over
+    for(std::size_t n = 0; n < allocations.size(); ++n)
+        requests[n].chunk->uploaded(arena, allocations[n]);
+
+    const std::size_t uploaded = allocations.size();
+    Profiler::instance().count("uploaded bytes", bytes);
+    // chunks still waiting are requested again next frame, at their new distance
+    requests.clear();
+    return uploaded;
+}
+
+}
@@ -0,0 +1,30 @@
+#ifndef GLUPLOADQUEUE_H
+#define GLUPLOADQUEUE_H
+
+#include "uploadqueue.h"
+#include "glbufferarena.h"
+
+namespace Glube {
+
+// An UploadQueue into a GLBufferArena. The vertices are copied into an orphaned
+// streaming buffer and moved into the arena with glCopyBufferSubData, so the copy
+// doesn't stall on meshes still being drawn. The time budget covers preparing the
+// meshes and copying them into the staging buffer, checked before each mesh; the
+// copies into the arena run on the GPU afterwards. drain() needs the GL context.
+class GLUploadQueue : public UploadQueue
+{
+public:
+    GLUploadQueue(GLBufferArena &arena);
+    virtual ~GLUploadQueue();
+
+    virtual std::size_t drain();
+
+private:
+    GLBufferArena &arena;
+    GLuint stagingBuffer;
+    std::size_t stagingSize;
+};
+
+}
+
+#endif // GLUPLOADQUEUE_H
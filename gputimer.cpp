@@ -0,0 +1,60 @@
+#include "gputimer.h"
+#include "profiler.h"
+
+namespace Glube {
+
+GpuTimer::GpuTimer(const char *name_):
+    name(name_),
+    next(0),
+    timing(false)
+{
+    for(int i = 0; i < QUERIES; ++i) {
+        queries[i].id = 0;
+        queries[i].frame = 0;
+        queries[i].pending = false;
+    }
+}
+
+GpuTimer::~GpuTimer()
+{
+    for(int i = 0; i < QUERIES; ++i) {
+        if(queries[i].id && glIsQuery(queries[i].id)) glDeleteQueries(1, &queries[i].id);
+    }
+}
+
+void GpuTimer::begin()
+{
+    collect();
+    Query &q = queries[next];
+    if(q.pending) return;
+    if(!q.id) glGenQueries(1, &q.id);
+    q.frame = Profiler::instance().frame();
+    glBeginQuery(GL_TIME_ELAPSED, q.id);
+    timing = true;
+}
+
+void GpuTimer::end()
+{
+    if(!timing) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    queries[next].pending = true;
+    next = (next + 1) % QUERIES;
+    timing = false;
+}
+
+void GpuTimer::collect()
+{
+    for(int i = 0; i < QUERIES; ++i) {
+        Query &q = queries[i];
+        if(!q.pending) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(q.id, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) continue;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(q.id, GL_QUERY_RESULT, &ns);
+        Profiler::instance().setCounter(q.frame, name, ns / 1e6);
+        q.pending = false;
+    }
+}
+
+}
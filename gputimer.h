@@ -0,0 +1,41 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <QtOpenGL>
+
+namespace Glube {
+
+// Times the GL commands between begin() and end() with GL_TIME_ELAPSED queries.
+// Several queries are in flight so reading one never waits for the GPU; each
+// result goes to the profiler as counter name, in milliseconds, on the frame it
+// was issued in. If every query is still pending, a frame goes untimed.
+class GpuTimer
+{
+public:
+    GpuTimer(const char *name);
+    virtual ~GpuTimer();
+
+    // both need the GL context
+    void begin();
+    void end();
+
+private:
+    static const int QUERIES = 4;
+    struct Query {
+        GLuint id;
+        unsigned long frame;
+        bool pending;
+    };
+
+    void collect();
+
+    const char *name;
+    Query queries[QUERIES];
+    int next;
+    bool timing;
+};
+
+}
+
+#endif // GPUTIMER_H
@@ -0,0 +1,130 @@
+#include "jobpool.h"
+#include "profiler.h"
+
+#include <boost/bind.hpp>
+
+#include <QDebug>
+
+namespace Glube {
+
+JobPool::JobPool(unsigned threads_):
+    workerCount(threads_),
+    queued(0),
+    nextWorker(0),
+    stopping(false)
+{
+    if(workerCount == 0) {
+        unsigned cores = boost::thread::hardware_concurrency();
+        workerCount = cores > 1 ? cores - 1 : 1;
+    }
+    workers.reset(new Worker[workerCount]);
+    for(std::size_t i = 0; i < workerCount; ++i) {
+        workers[i].id = threads.create_thread(boost::bind(&JobPool::run, this, i))->get_id();
+    }
+    qDebug() << "Job pool started with" << workerCount << "threads";
+}
+
+JobPool::~JobPool()
+{
+    stop();
+}
+
+bool JobPool::submit(const Job &job)
+{
+    // jobs submitted from a worker stay on that worker, others are spread round robin
+    std::size_t index = currentWorker();
+    if(index == workerCount) index = nextWorker++ % workerCount;
+    {
+        // checked under the lock stop() sets it with, so no job is queued after it
+        boost::mutex::scoped_lock lock(m_mutex);
+        if(stopping) return false;
+        {
+            boost::mutex::scoped_lock workerLock(workers[index].mutex);
+            workers[index].jobs.push_back(job);
+        }
+        ++queued;
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+void JobPool::stop()
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        if(stopping) return;
+        stopping = true;
+    }
+    m_wake.notify_all();
+    threads.join_all();
+
+    for(std::size_t i = 0; i < workerCount; ++i) {
+        workers[i].jobs.clear();
+    }
+    queued = 0;
+}
+
+std::size_t JobPool::threadCount() const
+{
+    return workerCount;
+}
+
+std::size_t JobPool::pendingJobs() const
+{
+    return queued;
+}
+
+void JobPool::run(std::size_t index)
+{
+    Job job;
+    while(!stopping) {
+        if(pop(index, job) || steal(index, job)) {
+            {
+                Profiler::Scope scope("job");
+                job();
+            }
+            job.clear();
+        } else {
+            boost::mutex::scoped_lock lock(m_mutex);
+            while(queued == 0 && !stopping) {
+                m_wake.wait(lock);
+            }
+        }
+    }
+}
+
+bool JobPool::pop(std::size_t index, Job &job)
+{
+    boost::mutex::scoped_lock lock(workers[index].mutex);
+    if(workers[index].jobs.empty()) return false;
+    job = workers[index].jobs.back();
+    workers[index].jobs.pop_back();
+    --queued;
+    return true;
+}
+
+bool JobPool::steal(std::size_t index, Job &job)
+{
+    for(std::size_t i = 1; i < workerCount; ++i) {
+        Worker &victim = workers[(index + i) % workerCount];
+        boost::mutex::scoped_lock lock(victim.mutex);
+        if(!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::size_t JobPool::currentWorker() const
+{
+    boost::thread::id id = boost::this_thread::get_id();
+    for(std::size_t i = 0; i < workerCount; ++i) {
+        if(workers[i].id == id) return i;
+    }
+    return workerCount;
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef JOBPOOL_H
+#define JOBPOOL_H
+
+#include <boost/function.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/atomic.hpp>
+using boost::scoped_array;
+
+#include <deque>
+
+namespace Glube {
+
+// Fixed set of worker threads, each with its own job deque. Workers run their
+// own jobs newest first and steal the oldest jobs from each other when idle.
+class JobPool
+{
+public:
+    typedef boost::function<void()> Job;
+
+    // threads == 0 sizes the pool to the core count, leaving one core for the GUI thread
+    JobPool(unsigned threads = 0);
+    virtual ~JobPool();
+
+    // returns false, dropping the job, once the pool is stopping
+    bool submit(const Job &job);
+    // finishes running jobs and discards queued ones
+    void stop();
+
+    std::size_t threadCount() const;
+    std::size_t pendingJobs() const;
+
+private:
+    struct Worker {
+        boost::mutex mutex;
+        std::deque<Job> jobs;
+        boost::thread::id id;
+    };
+
+    void run(std::size_t index);
+    bool pop(std::size_t index, Job &job);
+    bool steal(std::size_t index, Job &job);
+    std::size_t currentWorker() const;
+
+    std::size_t workerCount;
+    scoped_array<Worker> workers;
+    boost::thread_group threads;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_wake;
+    boost::atomic<std::size_t> queued;
+    boost::atomic<std::size_t> nextWorker;
+    boost::atomic<bool> stopping;
+};
+
+}
+#endif // JOBPOOL_H
@@ -1,26 +1,179 @@
 #include "mapnode.h"
+#include "drawbatch.h"
+#include "profiler.h"
+#include "uploadqueue.h"
+#include "frustum.h"
+#include "section.h"
 
 #include <QDebug>
 
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace Glube {
 
-MapNodeFactory::MapNodeFactory(std::size_t chunkSize_): chunkSize(chunkSize_), nodes()
+// frames a build request lives without being renewed
+const unsigned long BUILD_REQUEST_FRAMES = 4;
+// added to the priority of builds outside the view, so every node in it goes first
+const float OUT_OF_VIEW_PRIORITY = 1e6f;
+// sections of a node remeshed per update; one edit makes at most four stale
+const std::size_t REMESH_SECTIONS_PER_FRAME = 4;
+
+BuildQueue::BuildQueue(JobPool &pool_):
+    pool(pool_),
+    requests(),
+    frame(0)
+{
+}
+
+void BuildQueue::request(const shared_ptr<MapNode> &node, float priority)
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        std::map<MapNode*, Request>::iterator i = requests.find(node.get());
+        if(i != requests.end()) {
+            i->second.priority = priority;
+            i->second.frame = frame;
+            return;
+        }
+        Request r = { node, priority, frame, false };
+        requests[node.get()] = r;
+        // set and cleared under this lock, so it always agrees with the requests
+        node->setBuilding(true);
+    }
+    // one job per request; each runs whichever request is best when it starts, and
+    // does nothing if they have all been taken or cancelled by then
+    if(!pool.submit(boost::bind(&BuildQueue::runNext, this))) {
+        // the pool is stopping; a request no job will run is taken back
+        boost::mutex::scoped_lock lock(m_mutex);
+        std::map<MapNode*, Request>::iterator i = requests.find(node.get());
+        if(i != requests.end() && !i->second.running) {
+            requests.erase(i);
+            node->setBuilding(false);
+        }
+    }
+}
+
+void BuildQueue::nextFrame()
+{
+    // references to the cancelled nodes are let go after the lock
+    std::vector<shared_ptr<MapNode> > cancelled;
+    boost::mutex::scoped_lock lock(m_mutex);
+    ++frame;
+    std::map<MapNode*, Request>::iterator i = requests.begin();
+    while(i != requests.end()) {
+        if(!i->second.running && i->second.frame + BUILD_REQUEST_FRAMES < frame) {
+            shared_ptr<MapNode> node = i->second.node.lock();
+            if(node) {
+                node->setBuilding(false);
+                cancelled.push_back(node);
+            }
+            requests.erase(i++);
+        } else {
+            ++i;
+        }
+    }
+}
+
+bool BuildQueue::wanted(MapNode *node)
 {
+    boost::mutex::scoped_lock lock(m_mutex);
+    std::map<MapNode*, Request>::const_iterator i = requests.find(node);
+    return i != requests.end() && i->second.frame + BUILD_REQUEST_FRAMES >= frame;
 }
 
+std::size_t BuildQueue::pending()
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    std::size_t count = 0;
+    for(std::map<MapNode*, Request>::const_iterator i = requests.begin(); i != requests.end(); ++i) {
+        if(!i->second.running) ++count;
+    }
+    return count;
+}
+
+void BuildQueue::runNext()
+{
+    shared_ptr<MapNode> node;
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        std::map<MapNode*, Request>::iterator best = requests.end();
+        for(std::map<MapNode*, Request>::iterator i = requests.begin(); i != requests.end(); ++i) {
+            if(!i->second.running && (best == requests.end() || i->second.priority < best->second.priority))
+                best = i;
+        }
+        if(best == requests.end()) return;
+        // the reference keeps the node alive until the build is done with it
+        node = best->second.node.lock();
+        if(!node) {
+            requests.erase(best);
+            return;
+        }
+        best->second.running = true;
+    }
+    node->runBuild(*this);
+    boost::mutex::scoped_lock lock(m_mutex);
+    requests.erase(node.get());
+    node->setBuilding(false);
+}
+
+MapNodeFactory::MapNodeFactory(std::size_t chunkSize_, unsigned buildThreads):
+    chunkSize(chunkSize_),
+    meshMode(Chunk::NaiveMesh),
+    lodDistance(0),
+    generator(),
+    store(),
+    jobPool(buildThreads),
+    buildQueue(jobPool),
+    nodes(),
+    memoryBudget(0),
+    bytesResident(0),
+    frame(0)
+{
+}
+
+MapNodeFactory::~MapNodeFactory()
+{
+    // running builds still look up neighbours, so finish them before the nodes go
+    jobPool.stop();
+    flush();
+}
+
+MapNodeFactory::NodeMap::Key MapNodeFactory::key(long x, long z)
+{
+    return (NodeMap::Key)(boost::uint32_t)x << 32 | (boost::uint32_t)z;
+}
+
+static const long NEIGHBOUR_OFFSETS[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+
 shared_ptr<MapNode> MapNodeFactory::getMapNode(long x, long y)
 {
-    QString key = QString("%1x%2").arg(x).arg(y);
-    std::map<QString, shared_ptr<MapNode> >::iterator i = nodes.find(key);
-    if(i == nodes.end()) {
+    shared_ptr<MapNode> node = nodes.find(key(x, y));
+    if(node) return node;
+
+    NodeMap::Writer writer(nodes);
+    node = writer.find(key(x, y));
+    if(!node) {
         qDebug() << "Creating map node (" << x << "," << y << ")";
-        MapNode *node = new MapNode(x, y, chunkSize, *this);
-        nodes[key].reset(node);
+        node.reset(new MapNode(x, y, chunkSize, *this));
+        node->setMeshMode(meshMode);
+        node->lastKept = frame;
+        // links to and from the existing neighbours, so getNext rarely needs the factory
+        for(int d = 0; d < 4; ++d) {
+            shared_ptr<MapNode> n = writer.find(key(x + NEIGHBOUR_OFFSETS[d][0], y + NEIGHBOUR_OFFSETS[d][1]));
+            if(n) {
+                node->neighbours[d] = n.get();
+                n->neighbours[(d + 2) % 4] = node.get();
+            }
+        }
+        writer.insert(key(x, y), node);
     }
-    return nodes[key];
+    return node;
 }
 
 std::size_t MapNodeFactory::getChunkSize() const
@@ -28,59 +181,333 @@ std::size_t MapNodeFactory::getChunkSize() const
     return chunkSize;
 }
 
+JobPool &MapNodeFactory::getJobPool()
+{
+    return jobPool;
+}
+
+BuildQueue &MapNodeFactory::getBuildQueue()
+{
+    return buildQueue;
+}
+
+void MapNodeFactory::setMeshMode(Chunk::MeshMode mode)
+{
+    meshMode = mode;
+}
+
+void MapNodeFactory::setLodDistance(float distance)
+{
+    lodDistance = distance;
+}
+
+int MapNodeFactory::lodScale(float distance, int current) const
+{
+    static const int MAX_SCALE = 8;
+    static const float HYSTERESIS = 0.1f;
+    if(lodDistance <= 0) return 1;
+
+    int scale = 1;
+    for(int next = 2; next <= MAX_SCALE; next *= 2) {
+        const float boundary = lodDistance * next / 2;
+        // moving coarser has to pass the boundary by a margin, and so does moving back
+        if(distance >= boundary * (current >= next ? 1 - HYSTERESIS : 1 + HYSTERESIS)) scale = next;
+    }
+    return scale;
+}
+
+TerrainGenerator &MapNodeFactory::getTerrainGenerator()
+{
+    return generator;
+}
+
+void MapNodeFactory::setWorldDirectory(const QString &directory)
+{
+    store.reset(new RegionStore(directory, chunkSize));
+}
+
+RegionStore *MapNodeFactory::getRegionStore()
+{
+    return store.get();
+}
+
+void MapNodeFactory::flush()
+{
+    NodeMap::Writer writer(nodes);
+    for(NodeMap::Writer::Entry *e = writer.first(); e; e = writer.next(e)) {
+        e->value->save();
+    }
+}
+
+void MapNodeFactory::setMemoryBudget(std::size_t bytes)
+{
+    memoryBudget = bytes;
+}
+
+namespace {
+
+struct EvictionCandidate {
+    unsigned long lastKept;
+    long distance;
+    shared_ptr<MapNode> node;
+
+    bool operator<(const EvictionCandidate &o) const
+    {
+        return lastKept != o.lastKept ? lastKept < o.lastKept : distance > o.distance;
+    }
+};
+
+}
+
+void MapNodeFactory::evict(const QList<MapNode*> &keep, long x, long z)
+{
+    std::vector<shared_ptr<MapNode> > victims;
+    {
+        NodeMap::Writer writer(nodes);
+        ++frame;
+        foreach(MapNode *n, keep) {
+            n->lastKept = frame;
+        }
+
+        // workers only change a node's data while a build or remesh may touch it, and
+        // those only start on this thread, so a node's usage can be read whenever no
+        // build may touch it; otherwise the last figure read stands
+        std::size_t bytes = 0;
+        for(NodeMap::Writer::Entry *e = writer.first(); e; e = writer.next(e)) {
+            MapNode *n = e->value.get();
+            if(!buildMayTouch(n)) n->usage = n->memoryUsage();
+            bytes += n->usage;
+        }
+        bytesResident = bytes;
+        if(!memoryBudget || bytes <= memoryBudget) return;
+
+        std::vector<EvictionCandidate> candidates;
+        for(NodeMap::Writer::Entry *e = writer.first(); e; e = writer.next(e)) {
+            MapNode *n = e->value.get();
+            // only the map holds it, and no queued or running build can reach it
+            if(n->lastKept == frame || !e->value.unique() || buildMayTouch(n)) continue;
+            EvictionCandidate c = { n->lastKept, std::max(std::labs(n->x - x), std::labs(n->z - z)), e->value };
+            candidates.push_back(c);
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        for(std::size_t i = 0; i < candidates.size() && bytes > memoryBudget; ++i) {
+            MapNode *n = candidates[i].node.get();
+            bytes -= n->usage;
+            writer.erase(key(n->x, n->z));
+            for(int d = 0; d < 4; ++d) {
+                MapNode *neighbour = n->neighbours[d];
+                if(neighbour) neighbour->neighbours[(d + 2) % 4] = 0;
+            }
+            victims.push_back(candidates[i].node);
+        }
+        bytesResident = bytes;
+        // so the victims are destroyed here, on the thread that owns their buffers
+        writer.synchronize();
+    }
+
+    // the victims are out of the map and unlinked from their neighbours, so nothing
+    // can reach them any more; save and release them outside the lock
+    for(std::size_t i = 0; i < victims.size(); ++i) {
+        victims[i]->save();
+    }
+    if(!victims.empty()) {
+        qDebug() << "Evicted" << victims.size() << "map nodes," << residentNodes() << "resident using" << residentBytes() << "bytes";
+    }
+}
+
+std::size_t MapNodeFactory::residentNodes()
+{
+    return nodes.size();
+}
+
+std::size_t MapNodeFactory::residentBytes()
+{
+    return bytesResident;
+}
+
+bool MapNodeFactory::buildMayTouch(MapNode *node) const
+{
+    if(node->isBuilding()) return true;
+    // a build reads and generates its four neighbours
+    for(int d = 0; d < 4; ++d) {
+        MapNode *n = node->neighbours[d];
+        if(n && n->isBuilding()) return true;
+    }
+    return false;
+}
+
 
 MapNode::MapNode(long x_, long z_, std::size_t chunkSize, MapNodeFactory& fact):
     Drawable(glm::vec3(x_ * chunkSize - chunkSize / 2.0f, 0, z_ * chunkSize - chunkSize / 2.0f)),
     Chunk(chunkSize),
     x(x_), z(z_),
     factory(fact),
-    built(false)
+    building(false),
+    built(false),
+    buildScale(1),
+    remeshed(),
+    remeshedConnectivity(),
+    remeshedScale(0),
+    lastKept(0),
+    usage(0)
 {
+    for(int d = 0; d < 4; ++d) {
+        neighbours[d] = 0;
+    }
 }
 
 MapNode::~MapNode()
 {
-    if(m_buildThread) {
-        m_buildThread->join();
+    // nothing to wait for: build and remesh jobs hold a reference to the node
+}
+
+void MapNode::startBuild(int scale, float priority)
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        if(built.load(boost::memory_order_acquire)) return;
+        if(!building) buildScale = scale;
     }
+    factory.getBuildQueue().request(shared_from_this(), priority);
 }
 
-void MapNode::startBuild()
+void MapNode::runBuild(BuildQueue &queue)
 {
-    if(!built && !m_buildThread) {
-        m_buildThread.reset(new boost::thread(boost::bind(&MapNode::build, this)));
+    if(!build(&queue)) {
+        qDebug() << "Cancelled build of (" << x << "," << z << ")";
+    }
+}
+
+void MapNode::setBuilding(bool b)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    building = b;
+}
+
+void MapNode::runRemesh(int scale)
+{
+    std::vector<std::vector<Vertex> > meshes;
+    std::vector<unsigned short> connections;
+    {
+        Profiler::Scope scope("remesh");
+        buildMeshes(scale, meshes, connections);
+    }
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        remeshed.swap(meshes);
+        remeshedConnectivity.swap(connections);
+        remeshedScale = scale;
+        building = false;
     }
 }
 
 void MapNode::assignRandom()
 {
-    Chunk::assignRandom(x, 0, z);
+    Chunk::assignRandom(factory.getTerrainGenerator(), x, 0, z, factory.getRegionStore());
 }
 
-void MapNode::build() {
-    if(!built) {
-        qDebug() << "Building (" << x << "," << z << ")";
-        getNext(NORTH)->assignRandom();
-        getNext(EAST)->assignRandom();
-        getNext(SOUTH)->assignRandom();
-        getNext(WEST)->assignRandom();
+void MapNode::save()
+{
+    Chunk::save(factory.getRegionStore(), x, z);
+}
+
+bool MapNode::build(BuildQueue *queue)
+{
+    if(built.load(boost::memory_order_acquire)) return true;
+    qDebug() << "Building (" << x << "," << z << ")";
+    {
+        Profiler::Scope scope("generate");
+        // the neighbours first, meshing reads into them
+        for(int d = NORTH; d <= WEST; ++d) {
+            if(queue && !queue->wanted(this)) return false;
+            getNext(d)->assignRandom();
+        }
+        if(queue && !queue->wanted(this)) return false;
         assignRandom();
-        buildQuads();
-        built = true;
-        qDebug() << "Built (" << x << "," << z << ")";
     }
+    if(queue && !queue->wanted(this)) return false;
+    {
+        Profiler::Scope scope("mesh");
+        buildQuads(buildScale);
+    }
+    built.store(true, boost::memory_order_release);
+    qDebug() << "Built (" << x << "," << z << ")";
+    return true;
+}
+
+bool MapNode::isBuilt() const
+{
+    return built.load(boost::memory_order_acquire);
+}
+
+bool MapNode::isBuilding()
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    return building;
 }
 
-void MapNode::draw(QGLShaderProgram& shaderProg, const glm::mat4& parentModelMatrix)
+long MapNode::getX() const
 {
-    Drawable::draw(shaderProg, parentModelMatrix);
-    if(built) {
-        Chunk::draw();
+    return x;
+}
+
+long MapNode::getZ() const
+{
+    return z;
+}
+
+void MapNode::update(UploadQueue &uploads, const glm::vec3 &eye, const Frustum &view)
+{
+    const float distance = glm::length(glm::vec2(position.x - eye.x, position.z - eye.z));
+    if(built.load(boost::memory_order_acquire)) {
+        bool remeshing;
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            if(remeshedScale) {
+                setMeshes(remeshed, remeshedConnectivity, remeshedScale);
+                std::vector<std::vector<Vertex> >().swap(remeshed);
+                std::vector<unsigned short>().swap(remeshedConnectivity);
+                remeshedScale = 0;
+            }
+            // the current meshes are drawn until the new scale is ready; downsampled
+            // meshes are only built whole, so edits to them are remeshed this way too
+            const int scale = factory.lodScale(distance, getMeshScale());
+            if(!building && (scale != getMeshScale() || (scale > 1 && hasStaleSections()))) {
+                building = factory.getJobPool().submit(boost::bind(&MapNode::runRemesh, shared_from_this(), scale));
+            }
+            remeshing = building;
+        }
+        // edits to full detail meshes are remeshed here, a few sections a frame; while
+        // new meshes are being built the edits wait for them, or they would be lost in the swap
+        if(!remeshing) remeshStale(REMESH_SECTIONS_PER_FRAME);
+        if(needsUpload()) {
+            uploads.request(this, distance);
+        }
     } else {
-        startBuild();
+        const glm::vec3 min = position + meshOrigin();
+        const bool inView = view.intersects(min, min + glm::vec3(size));
+        startBuild(factory.lodScale(distance, 1), inView ? distance : distance + OUT_OF_VIEW_PRIORITY);
     }
 }
 
+void MapNode::draw(DrawBatch &batch, const glm::vec3 &eye, const unsigned char *visible)
+{
+    // mesh vertices are stored relative to the chunk's corner; there is no mesh to
+    // draw until update() has uploaded one after the build
+    Chunk::draw(batch, position + meshOrigin(), eye, visible);
+}
+
+std::size_t MapNode::sectionBoxes(BoxList &boxes) const
+{
+    return Chunk::sectionBoxes(boxes, position + meshOrigin());
+}
+
+std::size_t MapNode::occluderBoxes(BoxList &boxes)
+{
+    return built.load(boost::memory_order_acquire) ? Chunk::occluderBoxes(boxes, position + meshOrigin()) : 0;
+}
+
 void MapNode::deleteBuffers()
 {
     Chunk::deleteBuffers();
@@ -92,59 +519,128 @@ Chunk::BlockType MapNode::getBlock(int x, int y, int z)
     if(y < 0 || y >= size) return 0;
     MapNode* n = this;
     if(x < -si) {
-        n = n->getNext(WEST).get();
+        n = n->neighbour(WEST);
         x += size;
     } else if(x >= si) {
-        n = n->getNext(EAST).get();
+        n = n->neighbour(EAST);
         x -= size;
     }
     if(z < -si) {
-        n = n->getNext(NORTH).get();
+        n = n->neighbour(NORTH);
         z += size;
     } else if(z >= si) {
-        n = n->getNext(SOUTH).get();
+        n = n->neighbour(SOUTH);
         z -= size;
     }
     return n->Chunk::getBlock(x, y, z);
 }
 
+void MapNode::snapshotApron(Snapshot &s)
+{
+    // the border of the snapshot reaching into each neighbour; build() has already loaded their block data
+    if(s.x0 < 0) neighbour(WEST)->copyInto(s, -size, 0);
+    if(s.x0 + s.width > size) neighbour(EAST)->copyInto(s, size, 0);
+    if(s.z0 < 0) neighbour(NORTH)->copyInto(s, 0, -size);
+    if(s.z0 + s.depth > size) neighbour(SOUTH)->copyInto(s, 0, size);
+}
+
 void MapNode::setBlock(int x, int y, int z, BlockType value)
 {
     Chunk::setBlock(x, y, z, value);
-    built = false;
+    // faces of the neighbouring chunk's border blocks can appear or disappear too
+    const int si = size/2;
+    if(x == -si) neighbour(WEST)->markStale(x - 1 + size, y, z);
+    if(x == si - 1) neighbour(EAST)->markStale(x + 1 - size, y, z);
+    if(z == -si) neighbour(NORTH)->markStale(x, y, z - 1 + size);
+    if(z == si - 1) neighbour(SOUTH)->markStale(x, y, z + 1 - size);
 }
 
 shared_ptr<MapNode> MapNode::getNext(int direction)
 {
-    switch(direction) {
-    case NORTH: return factory.getMapNode(x, z - 1);
-    case EAST: return factory.getMapNode(x + 1, z);
-    case SOUTH: return factory.getMapNode(x, z + 1);
-    case WEST: return factory.getMapNode(x - 1, z);
+    if(direction < NORTH || direction > WEST) return shared_ptr<MapNode>();
+    return neighbour(direction)->shared_from_this();
+}
+
+MapNode *MapNode::neighbour(int direction)
+{
+    MapNode *n = neighbours[direction];
+    if(!n) {
+        // creating it links it to this node
+        n = factory.getMapNode(x + NEIGHBOUR_OFFSETS[direction][0], z + NEIGHBOUR_OFFSETS[direction][1]).get();
     }
+    return n;
+}
+
+namespace {
+
+// a section reached by findVisibleSections, with the corner of its node
+struct VisibilityStep {
+    MapNode *node;
+    glm::vec3 corner;
+    int x, y, z;
+    int entry;          // the face it was entered through, -1 for the eye's section
+    unsigned char dirs; // the directions stepped in to get here
+};
 
-    return shared_ptr<MapNode>();
 }
 
-void MapNode::findRecursive(const glm::vec3 &pos, float radius, List& nodeList)
+bool MapNode::findVisibleSections(MapNode *start, const glm::vec3 &eye, const Frustum &frustum,
+                                  float radius, unsigned frame)
 {
-    if(nodeList.contains(this)) return;
-    if(radius < glm::length(pos)) return;
-    nodeList.append(this);
+    const int count = start->sectionCount;
+    const float edge = Section::Size;
+    VisibilityStep first = { start, start->position + start->meshOrigin(), 0, 0, 0, -1, 0 };
+    const glm::vec3 local = (eye - first.corner) / edge;
+    if(local.y < 0 || local.y >= count) return false;
+    first.x = std::min(count - 1, std::max(0, (int)std::floor(local.x)));
+    first.y = (int)local.y;
+    first.z = std::min(count - 1, std::max(0, (int)std::floor(local.z)));
+
+    std::deque<VisibilityStep> queue;
+    start->visitedFrame[first.x + (first.y + first.z * count) * count] = frame;
+    queue.push_back(first);
+    while(!queue.empty()) {
+        const VisibilityStep step = queue.front();
+        queue.pop_front();
+        const int section = step.x + (step.y + step.z * count) * count;
+
+        for(int f = 0; f < 6; ++f) {
+            // never back towards the eye, and only through air
+            if(step.dirs & (1 << (f ^ 1))) continue;
+            if(step.entry >= 0 && step.node->isBuilt() && !step.node->facesConnected(section, step.entry, f)) continue;
 
-    setPos(pos);
+            VisibilityStep next = step;
+            next.entry = f ^ 1;
+            next.dirs = step.dirs | (1 << f);
+            const int delta = f & 1 ? 1 : -1;
+            switch(f / 2) {
+            case 0: next.x += delta; break;
+            case 1: next.y += delta; break;
+            case 2: next.z += delta; break;
+            }
+            if(next.y < 0 || next.y >= count) continue;
+            // into the neighbouring node; nodes not created yet end the search
+            if(next.x < 0 || next.x >= count || next.z < 0 || next.z >= count) {
+                const int direction = next.x < 0 ? WEST : next.x >= count ? EAST : next.z < 0 ? NORTH : SOUTH;
+                next.node = step.node->neighbours[direction];
+                if(!next.node) continue;
+                next.corner += glm::vec3((float)NEIGHBOUR_OFFSETS[direction][0], 0, (float)NEIGHBOUR_OFFSETS[direction][1]) * (float)step.node->size;
+                next.x = (next.x + count) % count;
+                next.z = (next.z + count) % count;
+            }
 
-    for(int i = 0; i < 4; ++i) {
-        MapNode *n = getNext(i).get();
+            const int index = next.x + (next.y + next.z * count) * count;
+            if(next.node->visitedFrame[index] == frame) continue;
+            const glm::vec3 min = next.corner + glm::vec3(next.x, next.y, next.z) * edge;
+            const glm::vec3 max = min + edge;
+            const glm::vec2 centre((min.x + max.x) / 2 - eye.x, (min.z + max.z) / 2 - eye.z);
+            if(glm::length(centre) > radius || !frustum.intersects(min, max)) continue;
 
-        float d = static_cast<float>(factory.getChunkSize());
-        switch(i) {
-        case NORTH: n->findRecursive(pos + glm::vec3(0, 0, -d), radius, nodeList); break;
-        case EAST: n->findRecursive(pos + glm::vec3(d, 0, 0), radius, nodeList); break;
-        case SOUTH: n->findRecursive(pos + glm::vec3(0, 0, d), radius, nodeList); break;
-        case WEST: n->findRecursive(pos + glm::vec3(-d, 0, 0), radius, nodeList); break;
+            next.node->visitedFrame[index] = frame;
+            queue.push_back(next);
         }
     }
+    return true;
 }
 
 }
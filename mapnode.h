@@ -3,30 +3,121 @@
 
 #include "drawable.h"
 #include "chunk.h"
+#include "jobpool.h"
+#include "terrain.h"
+#include "region.h"
+#include "concurrentmap.h"
 
+#include <boost/atomic.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 using boost::scoped_ptr;
 using boost::shared_ptr;
+using boost::weak_ptr;
+
+#include <QList>
 
 #include <map>
 
 namespace Glube {
 
 class MapNode;
+class UploadQueue;
+class BoxList;
+class Frustum;
+
+// Node builds waiting for a worker, lowest priority value first. The owner asks
+// again every frame while it still wants a node built, with the priority as it is
+// now; requests not renewed for a few frames are dropped, and a build that has
+// started checks between its steps that it is still wanted. A worker picks the
+// best request when it starts rather than when it was queued, so changes of
+// priority apply to every build not yet running.
+class BuildQueue
+{
+public:
+    BuildQueue(JobPool &pool);
+
+    // queues node's build, or renews and reprioritizes it if it's queued or running
+    void request(const shared_ptr<MapNode> &node, float priority);
+    // ends a frame: queued requests not renewed for a few frames are cancelled
+    void nextFrame();
+    // whether node's build was asked for recently enough to carry on
+    bool wanted(MapNode *node);
+    // requests not yet running
+    std::size_t pending();
+
+private:
+    struct Request {
+        weak_ptr<MapNode> node;
+        float priority;
+        unsigned long frame;  // last renewed
+        bool running;
+    };
+    void runNext();
+
+    JobPool &pool;
+    boost::mutex m_mutex;
+    std::map<MapNode*, Request> requests;
+    unsigned long frame;
+};
 
 class MapNodeFactory
 {
 public:
-    MapNodeFactory(std::size_t chunkSize);
+    MapNodeFactory(std::size_t chunkSize, unsigned buildThreads = 0);
+    virtual ~MapNodeFactory();
+    // safe to call from any thread; lookups of existing nodes take no lock
     shared_ptr<MapNode> getMapNode(long x, long y);
     std::size_t getChunkSize() const;
+    JobPool &getJobPool();
+    BuildQueue &getBuildQueue();
+    // applies to nodes created after the call
+    void setMeshMode(Chunk::MeshMode mode);
+    TerrainGenerator &getTerrainGenerator();
+
+    // Nodes farther than distance (0 = never) are meshed from block data downsampled
+    // 2x, beyond twice that 4x and beyond four times that 8x. A node only changes
+    // scale once it is a tenth past the boundary, so it doesn't flip back and forth.
+    void setLodDistance(float distance);
+    // the mesh scale for a node at distance currently meshed at scale current
+    int lodScale(float distance, int current) const;
+
+    // chunks are loaded from and saved to region files in directory
+    void setWorldDirectory(const QString &directory);
+    RegionStore *getRegionStore();
+    // writes every changed chunk back to the region files
+    void flush();
+
+    // Once resident nodes use more than bytes (0 = no limit), evict() drops the least
+    // recently kept nodes, farthest from (x, z) first. Nodes in keep, nodes held
+    // elsewhere and nodes a build may still touch are never dropped. evict() has to
+    // run on the thread that calls MapNode::update().
+    void setMemoryBudget(std::size_t bytes);
+    void evict(const QList<MapNode*> &keep, long x, long z);
+    std::size_t residentNodes();
+    std::size_t residentBytes();
 private:
+    typedef ConcurrentMap<MapNode> NodeMap;
+    static NodeMap::Key key(long x, long z);
+    bool buildMayTouch(MapNode *node) const;
+
     std::size_t chunkSize;
-    std::map<QString, shared_ptr<MapNode> > nodes;
+    Chunk::MeshMode meshMode;
+    float lodDistance;
+    TerrainGenerator generator;
+    scoped_ptr<RegionStore> store;
+    JobPool jobPool;
+    BuildQueue buildQueue;
+    NodeMap nodes;
+    std::size_t memoryBudget;
+    boost::atomic<std::size_t> bytesResident;
+    unsigned long frame;
 };
 
-class MapNode: public Drawable, public Chunk
+class MapNode: public Drawable, public Chunk, public boost::enable_shared_from_this<MapNode>
 {
 public:
     static const int NORTH = 0;
@@ -36,24 +127,69 @@ public:
 
     MapNode(long x, long z, std::size_t chunkSize, MapNodeFactory &fact);
     virtual ~MapNode();
-    void startBuild();
+    // Queues the node's build with meshes at scale (see Chunk::getMeshScale()) on the
+    // factory's BuildQueue, or renews the request; the build is cancelled unless this
+    // is repeated each frame until isBuilt().
+    void startBuild(int scale = 1, float priority = 0);
     void assignRandom();
-    void build();
+    // Generates the node and its neighbours and meshes it. With a queue, gives up
+    // between steps once the queue no longer wants the node; returns whether it's built.
+    bool build(BuildQueue *queue = 0);
+    bool isBuilt() const;
+    bool isBuilding();
+    void save();
+    long getX() const;
+    long getZ() const;
 
-    void draw(QGLShaderProgram &shaderProg, const glm::mat4 &parentModelMatrix);
+    // starts or renews the build, or remeshes edits and queues the mesh for upload if it
+    // changed; eye is the camera position in the same frame as pos(). Builds of nodes in
+    // view go first, nearest first, then the rest by distance. The mesh scale follows
+    // the node's distance from eye, the new meshes built in the background.
+    void update(UploadQueue &uploads, const glm::vec3 &eye, const Frustum &view);
+    // adds the last uploaded mesh to batch at this node's position, only the sections
+    // flagged in visible if it's given and without faces turned away from eye; see Chunk::draw
+    void draw(DrawBatch &batch, const glm::vec3 &eye, const unsigned char *visible = 0);
+    std::size_t sectionBoxes(BoxList &boxes) const;
+    std::size_t occluderBoxes(BoxList &boxes);
     void deleteBuffers();
     virtual Chunk::BlockType getBlock(int x, int y, int z);
     virtual void setBlock(int x, int y, int z, BlockType value);
     shared_ptr<MapNode> getNext(int direction);
 
     typedef QList<MapNode*> List;
-    void findRecursive(const glm::vec3 &pos, float radius, List &nodeList);
+
+    // Marks the sections that can be seen from eye, given in start's frame, as visited
+    // in frame (see Chunk::cullUnvisited). The search starts at the eye's section and
+    // steps only across section faces that air connects, away from the eye, into
+    // sections within frustum and radius. Returns false without marking anything if
+    // the eye is above or below the chunks.
+    static bool findVisibleSections(MapNode *start, const glm::vec3 &eye, const Frustum &frustum,
+                                    float radius, unsigned frame);
 private:
+    friend class MapNodeFactory;
+    friend class BuildQueue;
+    void runBuild(BuildQueue &queue);
+    void setBuilding(bool b);
+    void runRemesh(int scale);
+    virtual void snapshotApron(Snapshot &s);
+    // getNext without the reference count; the factory keeps the node alive
+    MapNode *neighbour(int direction);
+
     long x, z;
     MapNodeFactory &factory;
     boost::mutex m_mutex;
-    scoped_ptr<boost::thread> m_buildThread;
-    bool built;
+    bool building;  // a build is requested or running, or a remesh job queued or running
+    // set by the worker once the meshes are written, so loads that see it see them too
+    boost::atomic<bool> built;
+    int buildScale;
+    // meshes from runRemesh waiting to be swapped in on the GUI thread
+    std::vector<std::vector<Vertex> > remeshed;
+    std::vector<unsigned short> remeshedConnectivity;
+    int remeshedScale;
+    unsigned long lastKept;
+    std::size_t usage;  // memoryUsage() when evict() last could read it
+    // set by the factory when either node is created, cleared when either is evicted
+    boost::atomic<MapNode*> neighbours[4];
 };
 
 }
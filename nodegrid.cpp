@@ -0,0 +1,81 @@
+#include "nodegrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Glube {
+
+NodeGrid::NodeGrid(MapNodeFactory &factory_, float radius):
+    factory(factory_),
+    half(std::ceil(radius / factory_.getChunkSize())),
+    width(half * 2 + 1),
+    cells(),
+    inDisc(width * width, false),
+    ring(width * width),
+    current(),
+    centred(false),
+    cx(0),
+    cz(0)
+{
+    // a node is in range if its centre is, like the old flood fill from the camera's node
+    const float size = factory.getChunkSize();
+    for(int dz = -half; dz <= half; ++dz) {
+        for(int dx = -half; dx <= half; ++dx) {
+            if(std::sqrt((float)(dx * dx + dz * dz)) * size > radius) continue;
+            Cell c = { dx, dz };
+            cells.push_back(c);
+            inDisc[(dx + half) + (dz + half) * width] = true;
+        }
+    }
+    std::stable_sort(cells.begin(), cells.end());
+}
+
+NodeGrid::~NodeGrid()
+{
+}
+
+int NodeGrid::slot(long x, long z) const
+{
+    const long w = width;
+    return ((x % w + w) % w) + ((z % w + w) % w) * width;
+}
+
+bool NodeGrid::inRange(long dx, long dz) const
+{
+    return std::labs(dx) <= half && std::labs(dz) <= half && inDisc[(dx + half) + (dz + half) * width];
+}
+
+bool NodeGrid::recenter(const shared_ptr<MapNode> &centre, MapNode::List &left)
+{
+    const long x = centre->getX(), z = centre->getZ();
+    if(centred && x == cx && z == cz) return false;
+
+    // those no longer in range give up their ring; a slot a node keeps can't be
+    // wanted by another node in range, as no two cells in the square share one
+    foreach(MapNode *n, current) {
+        if(inRange(n->getX() - x, n->getZ() - z)) continue;
+        left.append(n);
+        ring[slot(n->getX(), n->getZ())].reset();
+    }
+
+    const float size = factory.getChunkSize();
+    current.clear();
+    for(std::size_t i = 0; i < cells.size(); ++i) {
+        const long nx = x + cells[i].dx, nz = z + cells[i].dz;
+        shared_ptr<MapNode> &s = ring[slot(nx, nz)];
+        if(!s) s = nx == x && nz == z ? centre : factory.getMapNode(nx, nz);
+        s->setPos(glm::vec3(cells[i].dx * size, 0, cells[i].dz * size));
+        current.append(s.get());
+    }
+    centred = true;
+    cx = x;
+    cz = z;
+    return true;
+}
+
+const MapNode::List &NodeGrid::nodes() const
+{
+    return current;
+}
+
+}
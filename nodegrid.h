@@ -0,0 +1,48 @@
+#ifndef NODEGRID_H
+#define NODEGRID_H
+
+#include "mapnode.h"
+
+#include <vector>
+
+namespace Glube {
+
+// The map nodes within a radius of the camera's node. They sit in a square grid
+// that wraps around, node (x, z) in slot (x mod width, z mod width), so when the
+// centre moves one node over only the row or column coming into range is fetched
+// from the factory. recenter() does nothing until the centre is another node;
+// nodes() lists those in range nearest first, with pos() relative to the centre.
+// The grid holds a reference to each, so the factory won't evict them.
+class NodeGrid
+{
+public:
+    NodeGrid(MapNodeFactory &factory, float radius);
+    virtual ~NodeGrid();
+
+    // Centres the grid on centre, appending the nodes that went out of range to
+    // left; returns false if centre already was the centre.
+    bool recenter(const shared_ptr<MapNode> &centre, MapNode::List &left);
+    const MapNode::List &nodes() const;
+
+private:
+    struct Cell {
+        int dx, dz;
+        bool operator<(const Cell &other) const { return dx * dx + dz * dz < other.dx * other.dx + other.dz * other.dz; }
+    };
+
+    int slot(long x, long z) const;
+    bool inRange(long dx, long dz) const;
+
+    MapNodeFactory &factory;
+    int half, width;
+    std::vector<Cell> cells;          // offsets from the centre in range, nearest first
+    std::vector<bool> inDisc;         // per offset in the width x width square
+    std::vector<shared_ptr<MapNode> > ring;
+    MapNode::List current;
+    bool centred;
+    long cx, cz;
+};
+
+}
+
+#endif // NODEGRID_H
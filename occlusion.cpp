@@ -0,0 +1,218 @@
+#include "occlusion.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Glube {
+
+// corners are numbered with bit 0 for x, 1 for y and 2 for z set at the box's max
+static const int BOX_FACES[6][4] = {
+    { 0, 4, 6, 2 }, { 1, 3, 7, 5 },  // -x, +x
+    { 0, 1, 5, 4 }, { 2, 6, 7, 3 },  // -y, +y
+    { 0, 2, 3, 1 }, { 4, 5, 7, 6 }   // -z, +z
+};
+
+// a box this much nearer than the occluders is kept, so faces lying on an
+// occluder's own surface aren't hidden by rounding
+static const float DEPTH_BIAS = 1e-6f;
+
+OcclusionCuller::OcclusionCuller(int width_, int height_):
+    width(width_),
+    height(height_),
+    levels(),
+    levelWidth(),
+    levelHeight(),
+    occluders(),
+    viewProjection(1.0f),
+    pending(false),
+    busy(false),
+    stopping(false)
+{
+    int w = width, h = height;
+    for(;;) {
+        levels.push_back(std::vector<float>(w * h, 1.0f));
+        levelWidth.push_back(w);
+        levelHeight.push_back(h);
+        if(w == 1 && h == 1) break;
+        w = std::max(1, (w + 1) / 2);
+        h = std::max(1, (h + 1) / 2);
+    }
+    thread = boost::thread(boost::bind(&OcclusionCuller::run, this));
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        stopping = true;
+    }
+    m_wake.notify_all();
+    thread.join();
+}
+
+void OcclusionCuller::render(const BoxList &occluders_, const glm::mat4 &viewProjection_)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    while(busy) m_done.wait(lock);
+    occluders = occluders_;
+    viewProjection = viewProjection_;
+    pending = busy = true;
+    m_wake.notify_one();
+}
+
+std::size_t OcclusionCuller::cull(const BoxList &boxes, std::vector<unsigned char> &visible)
+{
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        while(busy) m_done.wait(lock);
+    }
+    std::size_t hidden = 0;
+    for(std::size_t i = 0; i < boxes.size(); ++i) {
+        if(visible[i] && occluded(glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]),
+                                  glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]))) {
+            visible[i] = 0;
+            ++hidden;
+        }
+    }
+    return hidden;
+}
+
+void OcclusionCuller::run()
+{
+    for(;;) {
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            while(!pending && !stopping) m_wake.wait(lock);
+            if(stopping) return;
+            pending = false;
+        }
+        rasterize();
+        buildPyramid();
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            busy = false;
+        }
+        m_done.notify_all();
+    }
+}
+
+void OcclusionCuller::rasterize()
+{
+    std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+    for(std::size_t i = 0; i < occluders.size(); ++i) {
+        glm::vec4 clip[8];
+        for(int c = 0; c < 8; ++c) {
+            clip[c] = viewProjection * glm::vec4(c & 1 ? occluders.maxX[i] : occluders.minX[i],
+                                                 c & 2 ? occluders.maxY[i] : occluders.minY[i],
+                                                 c & 4 ? occluders.maxZ[i] : occluders.minZ[i], 1.0f);
+        }
+        // back faces are drawn too; the depth test keeps the front ones
+        for(int f = 0; f < 6; ++f) {
+            const int *q = BOX_FACES[f];
+            rasterizeTriangle(clip[q[0]], clip[q[1]], clip[q[2]]);
+            rasterizeTriangle(clip[q[0]], clip[q[2]], clip[q[3]]);
+        }
+    }
+}
+
+void OcclusionCuller::rasterizeTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+{
+    // in front of the near plane z < -w; such triangles would need clipping
+    if(a.z < -a.w || b.z < -b.w || c.z < -c.w) return;
+
+    // window coordinates; depth is linear in them
+    const glm::vec4 *v[3] = { &a, &b, &c };
+    float x[3], y[3], z[3];
+    for(int i = 0; i < 3; ++i) {
+        x[i] = (v[i]->x / v[i]->w * 0.5f + 0.5f) * width;
+        y[i] = (v[i]->y / v[i]->w * 0.5f + 0.5f) * height;
+        z[i] = v[i]->z / v[i]->w * 0.5f + 0.5f;
+    }
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if(std::fabs(area) < 1e-12f) return;
+    if(area < 0) {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+    }
+
+    const int x0 = std::max(0, (int)std::floor(std::min(x[0], std::min(x[1], x[2]))));
+    const int x1 = std::min(width - 1, (int)std::ceil(std::max(x[0], std::max(x[1], x[2]))));
+    const int y0 = std::max(0, (int)std::floor(std::min(y[0], std::min(y[1], y[2]))));
+    const int y1 = std::min(height - 1, (int)std::ceil(std::max(y[0], std::max(y[1], y[2]))));
+
+    std::vector<float> &depth = levels[0];
+    for(int py = y0; py <= y1; ++py) {
+        const float cy = py + 0.5f;
+        for(int px = x0; px <= x1; ++px) {
+            // pixel centres inside all three edges are covered
+            const float cx = px + 0.5f;
+            const float w0 = (x[2] - x[1]) * (cy - y[1]) - (y[2] - y[1]) * (cx - x[1]);
+            const float w1 = (x[0] - x[2]) * (cy - y[2]) - (y[0] - y[2]) * (cx - x[2]);
+            const float w2 = (x[1] - x[0]) * (cy - y[0]) - (y[1] - y[0]) * (cx - x[0]);
+            if(w0 < 0 || w1 < 0 || w2 < 0) continue;
+            const float d = (w0 * z[0] + w1 * z[1] + w2 * z[2]) / area;
+            float &stored = depth[px + py * width];
+            if(d < stored) stored = d;
+        }
+    }
+}
+
+void OcclusionCuller::buildPyramid()
+{
+    for(std::size_t l = 1; l < levels.size(); ++l) {
+        const std::vector<float> &below = levels[l - 1];
+        const int bw = levelWidth[l - 1], bh = levelHeight[l - 1];
+        std::vector<float> &level = levels[l];
+        for(int y = 0; y < levelHeight[l]; ++y) {
+            const int y0 = y * 2, y1 = std::min(y0 + 1, bh - 1);
+            for(int x = 0; x < levelWidth[l]; ++x) {
+                const int x0 = x * 2, x1 = std::min(x0 + 1, bw - 1);
+                level[x + y * levelWidth[l]] = std::max(std::max(below[x0 + y0 * bw], below[x1 + y0 * bw]),
+                                                        std::max(below[x0 + y1 * bw], below[x1 + y1 * bw]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::occluded(const glm::vec3 &min, const glm::vec3 &max) const
+{
+    float sx0 = width, sx1 = 0, sy0 = height, sy1 = 0, nearest = 1.0f;
+    for(int c = 0; c < 8; ++c) {
+        const glm::vec4 clip = viewProjection * glm::vec4(c & 1 ? max.x : min.x, c & 2 ? max.y : min.y,
+                                                          c & 4 ? max.z : min.z, 1.0f);
+        if(clip.z < -clip.w) return false;
+        const float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+        const float y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+        sx0 = std::min(sx0, x);
+        sx1 = std::max(sx1, x);
+        sy0 = std::min(sy0, y);
+        sy1 = std::max(sy1, y);
+        nearest = std::min(nearest, clip.z / clip.w * 0.5f + 0.5f);
+    }
+
+    // widened by a pixel, as occluders only cover the pixels whose centres they contain
+    const int x0 = std::max(0, (int)std::floor(sx0) - 1);
+    const int x1 = std::min(width - 1, (int)std::ceil(sx1) + 1);
+    const int y0 = std::max(0, (int)std::floor(sy0) - 1);
+    const int y1 = std::min(height - 1, (int)std::ceil(sy1) + 1);
+    if(x0 > x1 || y0 > y1) return false;
+
+    // the level where the area spans at most two texels each way
+    std::size_t l = 0;
+    while(l + 1 < levels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+        ++l;
+    const std::vector<float> &level = levels[l];
+    float farthest = 0;
+    for(int y = y0 >> l; y <= y1 >> l; ++y) {
+        for(int x = x0 >> l; x <= x1 >> l; ++x) {
+            farthest = std::max(farthest, level[x + y * levelWidth[l]]);
+        }
+    }
+    return nearest > farthest + DEPTH_BIAS;
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "frustum.h"
+
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <vector>
+
+namespace Glube {
+
+// Software occlusion culling, all on the CPU. render() hands a set of solid
+// occluder boxes to a worker thread, which rasterizes them into a small depth
+// buffer and builds a pyramid where each texel holds the farthest depth of the
+// four below it. cull() then hides boxes whose nearest point is behind the
+// farthest occluder depth over the area they cover. Occluder triangles crossing
+// the near plane are left out, and boxes crossing it are always kept.
+class OcclusionCuller
+{
+public:
+    OcclusionCuller(int width, int height);
+    virtual ~OcclusionCuller();
+
+    // starts rasterizing the occluders seen through viewProjection; they are copied
+    void render(const BoxList &occluders, const glm::mat4 &viewProjection);
+    // waits for render() to finish, then clears visible[i] for each box hidden
+    // behind the occluders; boxes already 0 are skipped. Returns the number hidden.
+    std::size_t cull(const BoxList &boxes, std::vector<unsigned char> &visible);
+
+private:
+    void run();
+    void rasterize();
+    void rasterizeTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+    void buildPyramid();
+    bool occluded(const glm::vec3 &min, const glm::vec3 &max) const;
+
+    int width, height;
+    // levels[0] is the depth buffer, each level after it half the size; depth is 0 at
+    // the near plane and 1 at the far one
+    std::vector<std::vector<float> > levels;
+    std::vector<int> levelWidth, levelHeight;
+
+    BoxList occluders;
+    glm::mat4 viewProjection;
+
+    boost::thread thread;
+    boost::mutex m_mutex;
+    boost::condition_variable m_wake, m_done;
+    bool pending, busy, stopping;
+};
+
+}
+
+#endif // OCCLUSION_H
@@ -0,0 +1,9 @@
+#version 330 core
+uniform sampler2D text;
+
+in vec2 uv;
+out vec4 fragColor;
+
+void main() {
+    fragColor = texture(text, uv);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+// x0, y0, x1, y1 of the quad in clip space
+uniform vec4 rect;
+
+out vec2 uv;
+
+void main() {
+    // a strip of four corners, no vertex data needed
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    uv = vec2(corner.x, 1.0 - corner.y);
+    gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);
+}
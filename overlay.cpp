@@ -0,0 +1,93 @@
+#include "overlay.h"
+
+#include <QPainter>
+#include <QFontMetrics>
+
+#include <algorithm>
+
+namespace Glube {
+
+const int MARGIN = 8;  // pixels, around the text and from the view's corner
+
+Overlay::Overlay():
+    program(),
+    vao(),
+    texture(0),
+    image(),
+    changed(false)
+{
+}
+
+Overlay::~Overlay()
+{
+    if(texture && glIsTexture(texture)) glDeleteTextures(1, &texture);
+}
+
+void Overlay::setText(const QStringList &lines)
+{
+    QFont font("Monospace");
+    font.setStyleHint(QFont::TypeWriter);
+    font.setPixelSize(12);
+    const QFontMetrics metrics(font);
+    int width = 0;
+    foreach(const QString &line, lines) {
+        width = std::max(width, metrics.width(line));
+    }
+
+    // premultiplied, so it's blended with (1, 1 - alpha)
+    image = QImage(width + MARGIN * 2, metrics.lineSpacing() * lines.size() + MARGIN * 2, QImage::Format_ARGB32_Premultiplied);
+    image.fill(qRgba(0, 0, 0, 160));
+    QPainter painter(&image);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    for(int i = 0; i < lines.size(); ++i) {
+        painter.drawText(MARGIN, MARGIN + metrics.ascent() + i * metrics.lineSpacing(), lines[i]);
+    }
+    changed = true;
+}
+
+void Overlay::draw(int viewportWidth, int viewportHeight)
+{
+    if(image.isNull() || viewportWidth <= 0 || viewportHeight <= 0) return;
+
+    if(!program.isLinked()) {
+        program.addShaderFromSourceFile(QGLShader::Vertex, ":/shaders/overlay-vertex.shader");
+        program.addShaderFromSourceFile(QGLShader::Fragment, ":/shaders/overlay-fragment.shader");
+        program.link();
+        vao.allocate();
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if(changed) {
+        // ARGB32 pixels are 0xAARRGGBB words, which BGRA with 8_8_8_8_REV reads on any byte order
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0,
+                     GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, image.constBits());
+        changed = false;
+    }
+
+    // the image's top row is the texture's first, at the top of the quad
+    const float left = -1 + 2.0f * MARGIN / viewportWidth, top = 1 - 2.0f * MARGIN / viewportHeight;
+    program.bind();
+    program.setUniformValue("rect", left, top - 2.0f * image.height() / viewportHeight,
+                            left + 2.0f * image.width() / viewportWidth, top);
+    program.setUniformValue("text", 0);
+
+    vao.bind();
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glBindVertexArray(0);
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <QGLShaderProgram>
+#include <QStringList>
+#include <QImage>
+
+#include "vao.h"
+
+namespace Glube {
+
+// Lines of text over the top left corner of the view. The text is painted into an
+// image with QPainter when it changes and drawn as one textured quad, since painting
+// on the GL widget itself needs the compatibility profile.
+class Overlay
+{
+public:
+    Overlay();
+    virtual ~Overlay();
+
+    void setText(const QStringList &lines);
+    // draws over whatever is bound; needs the GL context and leaves its own program
+    // bound, with depth testing back on
+    void draw(int viewportWidth, int viewportHeight);
+
+private:
+    QGLShaderProgram program;
+    VAO vao;
+    GLuint texture;
+    QImage image;
+    bool changed;
+};
+
+}
+
+#endif // OVERLAY_H
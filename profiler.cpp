@@ -0,0 +1,243 @@
+#include "profiler.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <boost/thread/locks.hpp>
+
+#include <algorithm>
+
+namespace Glube {
+
+// finished frames kept
+const std::size_t HISTORY = 600;
+
+Profiler &Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler():
+    clock(),
+    frames(),
+    threads(),
+    drawThread(-1),
+    enabled(true)
+{
+    clock.start();
+    Frame first;
+    first.number = 0;
+    first.start = first.end = 0;
+    frames.push_back(first);
+}
+
+Profiler::Scope::Scope(const char *name_):
+    name(name_),
+    start(Profiler::instance().now())
+{
+}
+
+Profiler::Scope::~Scope()
+{
+    Profiler &profiler = Profiler::instance();
+    profiler.record(name, start, profiler.now());
+}
+
+void Profiler::setEnabled(bool enabled_)
+{
+    enabled = enabled_;
+}
+
+void Profiler::nextFrame()
+{
+    const qint64 t = now();
+    boost::mutex::scoped_lock lock(m_mutex);
+    if(drawThread < 0) drawThread = threadIndex(boost::this_thread::get_id());
+    frames.back().end = t;
+    Frame next;
+    next.number = frames.back().number + 1;
+    next.start = next.end = t;
+    frames.push_back(next);
+    while(frames.size() > HISTORY + 1)
+        frames.pop_front();
+}
+
+unsigned long Profiler::frame()
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    return frames.back().number;
+}
+
+void Profiler::count(const char *name, double value)
+{
+    if(!enabled) return;
+    boost::mutex::scoped_lock lock(m_mutex);
+    frames.back().counters[name] += value;
+}
+
+void Profiler::setCounter(unsigned long frame, const char *name, double value)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    if(frame < frames.front().number || frame > frames.back().number) return;
+    frames[frame - frames.front().number].counters[name] = value;
+}
+
+qint64 Profiler::now() const
+{
+    return clock.nsecsElapsed();
+}
+
+void Profiler::record(const char *name, qint64 start, qint64 end)
+{
+    if(!enabled) return;
+    boost::mutex::scoped_lock lock(m_mutex);
+    Event e = { name, start, end, threadIndex(boost::this_thread::get_id()) };
+    frames.back().events.push_back(e);
+}
+
+int Profiler::threadIndex(boost::thread::id id)
+{
+    std::map<boost::thread::id, int>::iterator i = threads.find(id);
+    if(i != threads.end()) return i->second;
+    const int index = threads.size();
+    threads[id] = index;
+    return index;
+}
+
+void Profiler::names(std::vector<std::string> &scopes, std::vector<std::string> &counters) const
+{
+    for(std::deque<Frame>::const_iterator f = frames.begin(); f != frames.end(); ++f) {
+        for(std::size_t i = 0; i < f->events.size(); ++i) {
+            if(std::find(scopes.begin(), scopes.end(), f->events[i].name) == scopes.end())
+                scopes.push_back(f->events[i].name);
+        }
+        for(std::map<std::string, double>::const_iterator c = f->counters.begin(); c != f->counters.end(); ++c) {
+            if(std::find(counters.begin(), counters.end(), c->first) == counters.end())
+                counters.push_back(c->first);
+        }
+    }
+}
+
+QStringList Profiler::summary(std::size_t count)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    QStringList lines;
+    // the open frame isn't finished, and the first is only the time before it
+    count = std::min(count, frames.size() - 1);
+    if(!count) return lines;
+    const std::size_t first = frames.size() - 1 - count;
+
+    double frameMean = 0, frameMax = 0;
+    std::vector<std::string> scopes, counters;
+    for(std::size_t f = first; f < frames.size() - 1; ++f) {
+        const double ms = (frames[f].end - frames[f].start) / 1e6;
+        frameMean += ms / count;
+        frameMax = std::max(frameMax, ms);
+    }
+    lines << QString("frame %1 ms, worst %2, %3 fps")
+             .arg(frameMean, 0, 'f', 2).arg(frameMax, 0, 'f', 2).arg(frameMean > 0 ? 1000 / frameMean : 0, 0, 'f', 0);
+
+    names(scopes, counters);
+    for(std::size_t s = 0; s < scopes.size(); ++s) {
+        double mean = 0, worst = 0;
+        for(std::size_t f = first; f < frames.size() - 1; ++f) {
+            double total = 0;
+            for(std::size_t i = 0; i < frames[f].events.size(); ++i) {
+                const Event &e = frames[f].events[i];
+                if(scopes[s] == e.name) total += (e.end - e.start) / 1e6;
+            }
+            mean += total / count;
+            worst = std::max(worst, total);
+        }
+        lines << QString("%1 %2 ms, worst %3").arg(QString::fromStdString(scopes[s]), -16)
+                 .arg(mean, 7, 'f', 2).arg(worst, 0, 'f', 2);
+    }
+    for(std::size_t c = 0; c < counters.size(); ++c) {
+        double mean = 0, worst = 0;
+        std::size_t seen = 0;
+        for(std::size_t f = first; f < frames.size() - 1; ++f) {
+            std::map<std::string, double>::const_iterator i = frames[f].counters.find(counters[c]);
+            if(i == frames[f].counters.end()) continue;
+            mean += i->second;
+            worst = std::max(worst, i->second);
+            ++seen;
+        }
+        if(seen) mean /= seen;
+        lines << QString("%1 %2, worst %3").arg(QString::fromStdString(counters[c]), -16)
+                 .arg(mean, 10, 'f', 1).arg(worst, 0, 'f', 1);
+    }
+    return lines;
+}
+
+bool Profiler::writeCsv(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) return false;
+    QTextStream out(&file);
+
+    boost::mutex::scoped_lock lock(m_mutex);
+    std::vector<std::string> scopes, counters;
+    names(scopes, counters);
+    out << "frame,start ms,frame ms";
+    for(std::size_t s = 0; s < scopes.size(); ++s) out << "," << QString::fromStdString(scopes[s]) << " ms";
+    for(std::size_t c = 0; c < counters.size(); ++c) out << "," << QString::fromStdString(counters[c]);
+    out << "\n";
+
+    // scopes are summed over all threads; counters a frame didn't set are left empty
+    for(std::size_t f = 1; f + 1 < frames.size(); ++f) {
+        const Frame &frame = frames[f];
+        out << frame.number << "," << frame.start / 1e6 << "," << (frame.end - frame.start) / 1e6;
+        for(std::size_t s = 0; s < scopes.size(); ++s) {
+            double total = 0;
+            for(std::size_t i = 0; i < frame.events.size(); ++i) {
+                if(scopes[s] == frame.events[i].name) total += (frame.events[i].end - frame.events[i].start) / 1e6;
+            }
+            out << "," << total;
+        }
+        for(std::size_t c = 0; c < counters.size(); ++c) {
+            std::map<std::string, double>::const_iterator i = frame.counters.find(counters[c]);
+            out << ",";
+            if(i != frame.counters.end()) out << i->second;
+        }
+        out << "\n";
+    }
+    return out.status() == QTextStream::Ok;
+}
+
+bool Profiler::writeTrace(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) return false;
+    QTextStream out(&file);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+
+    // trace times are in microseconds
+    boost::mutex::scoped_lock lock(m_mutex);
+    out << "{\"traceEvents\":[\n";
+    for(std::map<boost::thread::id, int>::const_iterator t = threads.begin(); t != threads.end(); ++t) {
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t->second
+            << ",\"args\":{\"name\":\"" << (t->second == drawThread ? QString("draw") : QString("thread %1").arg(t->second))
+            << "\"}},\n";
+    }
+    for(std::size_t f = 1; f + 1 < frames.size(); ++f) {
+        const Frame &frame = frames[f];
+        out << "{\"name\":\"frame " << frame.number << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << std::max(drawThread, 0)
+            << ",\"ts\":" << frame.start / 1e3 << ",\"dur\":" << (frame.end - frame.start) / 1e3 << "},\n";
+        for(std::size_t i = 0; i < frame.events.size(); ++i) {
+            const Event &e = frame.events[i];
+            out << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+                << ",\"ts\":" << e.start / 1e3 << ",\"dur\":" << (e.end - e.start) / 1e3 << "},\n";
+        }
+        for(std::map<std::string, double>::const_iterator c = frame.counters.begin(); c != frame.counters.end(); ++c) {
+            out << "{\"name\":\"" << QString::fromStdString(c->first) << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << frame.start / 1e3
+                << ",\"args\":{\"value\":" << c->second << "}},\n";
+        }
+    }
+    // the trailing comma of the last event needs something after it
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"glube\"}}\n]}\n";
+    return out.status() == QTextStream::Ok;
+}
+
+}
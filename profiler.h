@@ -0,0 +1,91 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Glube {
+
+// Timings and counters per frame. Scopes can be timed on any thread, and land in
+// the frame that is open when they end. The last frames are kept so a hitch can be
+// looked at or exported after it happens: summary() feeds the on-screen overlay,
+// writeCsv() gives a row per frame and writeTrace() a Chrome trace
+// (chrome://tracing, Perfetto) with every scope on its thread.
+class Profiler
+{
+public:
+    static Profiler &instance();
+
+    // while disabled, scopes and counters are dropped without taking the lock; for
+    // programs that never call nextFrame(), like the benchmarks, so nothing piles up
+    void setEnabled(bool enabled);
+
+    // times the enclosing block; name has to outlive the profiler, a literal
+    class Scope
+    {
+    public:
+        Scope(const char *name);
+        ~Scope();
+    private:
+        const char *name;
+        qint64 start;
+    };
+
+    // finishes the open frame and opens the next, on the thread that draws
+    void nextFrame();
+    unsigned long frame();
+
+    // adds value to the open frame's counter
+    void count(const char *name, double value);
+    // sets a counter of a frame that may have finished, for results that come in
+    // late like GPU timings; frames no longer kept are ignored
+    void setCounter(unsigned long frame, const char *name, double value);
+
+    // lines for the overlay: the frame time, then the mean and worst of each scope's
+    // total per frame and each counter over the last frames
+    QStringList summary(std::size_t frames);
+    bool writeCsv(const QString &path);
+    bool writeTrace(const QString &path);
+
+    // nanoseconds since the profiler started
+    qint64 now() const;
+    void record(const char *name, qint64 start, qint64 end);
+
+private:
+    Profiler();
+
+    struct Event {
+        const char *name;
+        qint64 start, end;
+        int thread;
+    };
+    struct Frame {
+        unsigned long number;
+        qint64 start, end;
+        std::vector<Event> events;
+        std::map<std::string, double> counters;
+    };
+    int threadIndex(boost::thread::id id);
+    // scope and counter names of the frames kept, in order of first use
+    void names(std::vector<std::string> &scopes, std::vector<std::string> &counters) const;
+
+    QElapsedTimer clock;
+    boost::mutex m_mutex;
+    std::deque<Frame> frames;  // the last one is open
+    std::map<boost::thread::id, int> threads;
+    int drawThread;
+    boost::atomic<bool> enabled;
+};
+
+}
+
+#endif // PROFILER_H
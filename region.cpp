@@ -0,0 +1,207 @@
+#include "region.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+
+#include <cstring>
+
+namespace Glube {
+
+namespace {
+
+struct Header {
+    char magic[4];
+    quint32 version;
+    quint32 chunkSize;
+    quint32 reserved;
+};
+
+struct Entry {
+    quint32 offset;
+    quint32 length;
+};
+
+const quint32 Version = 1;
+const qint64 TableOffset = sizeof(Header);
+const qint64 DataOffset = TableOffset + RegionStore::RegionSize * RegionStore::RegionSize * sizeof(Entry);
+
+long floorDiv(long a, long b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void encode(const Chunk::BlockType *blocks, std::size_t count, QByteArray &out)
+{
+    out.clear();
+    for(std::size_t i = 0; i < count;) {
+        const Chunk::BlockType block = blocks[i];
+        std::size_t run = 1;
+        while(run < 256 && i + run < count && blocks[i + run] == block)
+            ++run;
+        out.append(static_cast<char>(run - 1));
+        out.append(static_cast<char>(block));
+        i += run;
+    }
+}
+
+bool decode(const uchar *data, std::size_t length, Chunk::BlockType *blocks, std::size_t count)
+{
+    if(length % 2) return false;
+    std::size_t filled = 0;
+    for(std::size_t i = 0; i < length; i += 2) {
+        const std::size_t run = data[i] + 1;
+        if(filled + run > count) return false;
+        std::memset(blocks + filled, data[i + 1], run);
+        filled += run;
+    }
+    return filled == count;
+}
+
+}
+
+class RegionStore::Region
+{
+public:
+    Region(const QString &path, int chunkSize_):
+        file(path),
+        data(0),
+        dataSize(0),
+        chunkSize(chunkSize_),
+        valid(false)
+    {
+        if(!file.open(QIODevice::ReadWrite)) {
+            qWarning() << "Cannot open region file" << path << ":" << file.errorString();
+            return;
+        }
+
+        if(file.size() == 0) {
+            Header header = { { 'G', 'L', 'R', 'G' }, Version, (quint32)chunkSize, 0 };
+            QByteArray table(DataOffset - TableOffset, 0);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(table);
+            file.flush();
+        }
+        remap();
+
+        if(dataSize < DataOffset) {
+            qWarning() << "Region file" << path << "is truncated";
+            return;
+        }
+        const Header *header = reinterpret_cast<const Header*>(data);
+        if(std::memcmp(header->magic, "GLRG", 4) != 0 || header->version != Version
+           || header->chunkSize != (quint32)chunkSize) {
+            qWarning() << "Region file" << path << "has an unknown format or chunk size, ignoring it";
+            return;
+        }
+        valid = true;
+    }
+
+    ~Region()
+    {
+        if(data) file.unmap(data);
+    }
+
+    bool load(int index, Chunk::BlockType *blocks)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        if(!valid) return false;
+        const Entry &entry = reinterpret_cast<const Entry*>(data + TableOffset)[index];
+        if(!entry.length || entry.offset < DataOffset || entry.offset + (qint64)entry.length > dataSize)
+            return false;
+        const std::size_t count = (std::size_t)chunkSize * chunkSize * chunkSize;
+        return decode(data + entry.offset, entry.length, blocks, count);
+    }
+
+    bool save(int index, const QByteArray &blob)
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        if(!valid) return false;
+        const Entry old = reinterpret_cast<const Entry*>(data + TableOffset)[index];
+        Entry entry;
+        entry.offset = old.offset && (quint32)blob.size() <= old.length ? old.offset : (quint32)file.size();
+        entry.length = blob.size();
+
+        if(!file.seek(entry.offset) || file.write(blob) != blob.size()) return false;
+        if(!file.seek(TableOffset + index * sizeof(Entry))
+           || file.write(reinterpret_cast<const char*>(&entry), sizeof(entry)) != sizeof(entry))
+            return false;
+        file.flush();
+        if(file.size() != dataSize) remap();
+        return true;
+    }
+
+private:
+    void remap()
+    {
+        if(data) file.unmap(data);
+        dataSize = file.size();
+        data = file.map(0, dataSize);
+        if(!data) {
+            qWarning() << "Cannot map region file" << file.fileName() << ":" << file.errorString();
+            dataSize = 0;
+            valid = false;
+        }
+    }
+
+    QFile file;
+    uchar *data;
+    qint64 dataSize;
+    int chunkSize;
+    bool valid;
+    boost::mutex m_mutex;
+};
+
+RegionStore::RegionStore(const QString &directory_, int chunkSize_):
+    directory(directory_),
+    chunkSize(chunkSize_),
+    regions(),
+    uses(0)
+{
+    QDir().mkpath(directory);
+}
+
+RegionStore::~RegionStore()
+{
+}
+
+bool RegionStore::load(long x, long z, Chunk::BlockType *blocks)
+{
+    const long rx = floorDiv(x, RegionSize), rz = floorDiv(z, RegionSize);
+    return region(x, z)->load((x - rx * RegionSize) + (z - rz * RegionSize) * RegionSize, blocks);
+}
+
+bool RegionStore::save(long x, long z, const Chunk::BlockType *blocks)
+{
+    QByteArray blob;
+    encode(blocks, (std::size_t)chunkSize * chunkSize * chunkSize, blob);
+    const long rx = floorDiv(x, RegionSize), rz = floorDiv(z, RegionSize);
+    return region(x, z)->save((x - rx * RegionSize) + (z - rz * RegionSize) * RegionSize, blob);
+}
+
+shared_ptr<RegionStore::Region> RegionStore::region(long x, long z)
+{
+    const std::pair<long, long> key(floorDiv(x, RegionSize), floorDiv(z, RegionSize));
+    boost::mutex::scoped_lock lock(m_mutex);
+    OpenRegion &open = regions[key];
+    if(!open.region) {
+        open.region.reset(new Region(QDir(directory).filePath(QString("r.%1.%2.glr").arg(key.first).arg(key.second)), chunkSize));
+    }
+    open.lastUsed = ++uses;
+    shared_ptr<Region> r = open.region;
+
+    // close the least recently used files; one still being read or written stays open
+    while(regions.size() > MaxOpenRegions) {
+        RegionMap::iterator oldest = regions.end();
+        for(RegionMap::iterator i = regions.begin(); i != regions.end(); ++i) {
+            if(i->second.region.unique() && (oldest == regions.end() || i->second.lastUsed < oldest->second.lastUsed))
+                oldest = i;
+        }
+        if(oldest == regions.end()) break;
+        regions.erase(oldest);
+    }
+    return r;
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "chunk.h"
+
+#include <QString>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+using boost::shared_ptr;
+
+#include <map>
+
+namespace Glube {
+
+// Persistent chunk block data, grouped into region files of RegionSize x RegionSize
+// chunk columns. A region file is
+//
+//   header   "GLRG", version, chunk size, reserved     (4 x quint32)
+//   table    offset and length of each chunk blob      (RegionSize^2 x 2 x quint32, 0 = absent)
+//   blobs    run-length encoded block data: (run length - 1, block) byte pairs,
+//            in Chunk's (x, y, z) order
+//
+// in native byte order. Files are memory-mapped for loading. A rewritten chunk
+// reuses its old blob when the new one fits, otherwise it is appended. At most
+// MaxOpenRegions files are kept open, the least recently used closed first.
+class RegionStore
+{
+public:
+    static const int RegionSize = 8;
+    static const std::size_t MaxOpenRegions = 16;
+
+    RegionStore(const QString &directory, int chunkSize);
+    virtual ~RegionStore();
+
+    // blocks is chunkSize^3 in Chunk's layout; returns false if the chunk is not stored
+    bool load(long x, long z, Chunk::BlockType *blocks);
+    bool save(long x, long z, const Chunk::BlockType *blocks);
+
+private:
+    class Region;
+    struct OpenRegion {
+        shared_ptr<Region> region;
+        unsigned long lastUsed;
+    };
+    typedef std::map<std::pair<long, long>, OpenRegion> RegionMap;
+    shared_ptr<Region> region(long x, long z);
+
+    QString directory;
+    int chunkSize;
+    boost::mutex m_mutex;
+    RegionMap regions;
+    unsigned long uses;
+};
+
+}
+#endif // REGION_H
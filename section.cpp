@@ -0,0 +1,121 @@
+#include "section.h"
+
+#include <algorithm>
+
+namespace Glube {
+
+namespace {
+
+int bitsFor(std::size_t paletteSize)
+{
+    int bits = 1;
+    while((1u << bits) < paletteSize)
+        bits *= 2;
+    return bits;
+}
+
+}
+
+Section::Section():
+    uniform(0),
+    bits(0),
+    palette(),
+    words()
+{
+}
+
+void Section::set(int index, Chunk::BlockType value)
+{
+    if(!bits) {
+        if(value == uniform) return;
+        palette.push_back(uniform);
+        repack(1);
+    }
+
+    std::vector<Chunk::BlockType>::iterator i = std::find(palette.begin(), palette.end(), value);
+    const std::size_t entry = i - palette.begin();
+    if(i == palette.end()) {
+        palette.push_back(value);
+        if(palette.size() > (1u << bits)) repack(bits * 2);
+    }
+
+    const int bit = index * bits;
+    boost::uint64_t &word = words[bit >> 6];
+    const boost::uint64_t mask = (boost::uint64_t)((1u << bits) - 1) << (bit & 63);
+    word = (word & ~mask) | ((boost::uint64_t)entry << (bit & 63));
+}
+
+void Section::fill(const Chunk::BlockType *blocks, int yStride, int zStride)
+{
+    // palette in order of first appearance; slot maps a block type to its entry
+    int slot[256];
+    std::fill(slot, slot + 256, -1);
+    palette.clear();
+    for(int z = 0; z < Size; ++z) {
+        for(int y = 0; y < Size; ++y) {
+            const Chunk::BlockType *row = blocks + y * yStride + z * zStride;
+            for(int x = 0; x < Size; ++x) {
+                if(slot[row[x]] < 0) {
+                    slot[row[x]] = palette.size();
+                    palette.push_back(row[x]);
+                }
+            }
+        }
+    }
+
+    if(palette.size() == 1) {
+        uniform = palette[0];
+        bits = 0;
+        std::vector<Chunk::BlockType>().swap(palette);
+        std::vector<boost::uint64_t>().swap(words);
+        return;
+    }
+
+    bits = bitsFor(palette.size());
+    words.assign(Volume * bits / 64, 0);
+    for(int z = 0, index = 0; z < Size; ++z) {
+        for(int y = 0; y < Size; ++y) {
+            const Chunk::BlockType *row = blocks + y * yStride + z * zStride;
+            for(int x = 0; x < Size; ++x, ++index) {
+                const int bit = index * bits;
+                words[bit >> 6] |= (boost::uint64_t)slot[row[x]] << (bit & 63);
+            }
+        }
+    }
+}
+
+void Section::copyTo(Chunk::BlockType *blocks, int yStride, int zStride) const
+{
+    for(int z = 0, index = 0; z < Size; ++z) {
+        for(int y = 0; y < Size; ++y, index += Size) {
+            Chunk::BlockType *row = blocks + y * yStride + z * zStride;
+            if(!bits) {
+                std::fill(row, row + Size, uniform);
+            } else {
+                for(int x = 0; x < Size; ++x) {
+                    row[x] = get(index + x);
+                }
+            }
+        }
+    }
+}
+
+std::size_t Section::memoryUsage() const
+{
+    return sizeof(Section) + palette.capacity() * sizeof(Chunk::BlockType)
+            + words.capacity() * sizeof(boost::uint64_t);
+}
+
+void Section::repack(int newBits)
+{
+    std::vector<boost::uint64_t> packed(Volume * newBits / 64, 0);
+    for(int index = 0; index < Volume; ++index) {
+        const boost::uint64_t entry = bits ? (words[index * bits >> 6] >> (index * bits & 63)) & ((1u << bits) - 1) : 0;
+        const int bit = index * newBits;
+        packed[bit >> 6] |= entry << (bit & 63);
+    }
+    words.swap(packed);
+    bits = newBits;
+}
+
+}
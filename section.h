@@ -0,0 +1,64 @@
+#ifndef SECTION_H
+#define SECTION_H
+
+#include "chunk.h"
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+namespace Glube {
+
+// Block storage for a Size^3 cube of a chunk, indexed x + y * Size + z * Size * Size.
+// A section holding one block type stores just that value. Otherwise it keeps a
+// palette of the types it holds and a 1, 2, 4 or 8 bit palette index per block,
+// packed into 64 bit words; the index width grows as setBlock adds types.
+class Section
+{
+public:
+    static const int Shift = 4;
+    static const int Size = 1 << Shift;
+    static const int Volume = Size * Size * Size;
+
+    Section();
+
+    Chunk::BlockType get(int index) const;
+    void set(int index, Chunk::BlockType value);
+
+    // bulk access; stride is the distance between rows along y and z in blocks,
+    // so a section can be read from or written to its place in a larger dense array
+    void fill(const Chunk::BlockType *blocks, int yStride, int zStride);
+    void copyTo(Chunk::BlockType *blocks, int yStride, int zStride) const;
+
+    bool isUniform() const;
+    Chunk::BlockType uniformValue() const;
+    std::size_t memoryUsage() const;
+
+private:
+    void repack(int newBits);
+
+    Chunk::BlockType uniform;
+    int bits;  // 0 while uniform
+    std::vector<Chunk::BlockType> palette;
+    std::vector<boost::uint64_t> words;
+};
+
+inline Chunk::BlockType Section::get(int index) const
+{
+    if(!bits) return uniform;
+    const int bit = index * bits;
+    return palette[(words[bit >> 6] >> (bit & 63)) & ((1u << bits) - 1)];
+}
+
+inline bool Section::isUniform() const
+{
+    return bits == 0;
+}
+
+inline Chunk::BlockType Section::uniformValue() const
+{
+    return uniform;
+}
+
+}
+#endif // SECTION_H
@@ -2,6 +2,8 @@
 #include "simplex.h"
 
 #include <math.h>
+#include <pthread.h>
+#include <string.h>
 
 float grad[12][3] = {
     {1.0,1.0,0.0},{-1.0,1.0,0.0},{1.0,-1.0,0.0},{-1.0,-1.0,0.0},
@@ -116,13 +118,294 @@ float noise(float xin, float yin, float zin){
 
 float simplex_noise(int octaves, float x, float y, float z){
     float value = 0.0;
+    float scale = 1.0;
     int i;
+    /* scaling by a power of two is exact, so this matches x*pow(2, i) */
     for(i=0; i<octaves; i++){
         value += noise(
-            x*pow(2, i),
-            y*pow(2, i),
-            z*pow(2, i)
+            x*scale,
+            y*scale,
+            z*scale
         );
+        scale *= 2;
     }
     return value;
 }
+
+/*
+ * Batch kernels. These follow noise() operation for operation - including the
+ * steps C promotes to double - so every kernel gives the same bits as the scalar
+ * code. The simplex corner ordering is computed with masks instead of branches:
+ *   i1 = x>=y & (y>=z | x>=z)    i2 = x>=y | (y>=z & x>=z)
+ *   j1 = x<y & y>=z              j2 = x<y | y>=z
+ *   k1 = y<z & !(x>=y & x>=z)    k2 = !(y>=z & (x>=y | x>=z))
+ */
+
+typedef void (*noise_kernel)(float scale, const float *x, const float *y, const float *z, float *out, int count);
+
+static void noise_scalar(float scale, const float *x, const float *y, const float *z, float *out, int count){
+    int n;
+    for(n=0; n<count; n++){
+        out[n] += noise(x[n]*scale, y[n]*scale, z[n]*scale);
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMPLEX_X86 1
+#include <immintrin.h>
+
+/* 0.6 - x*x - y*y - z*z, evaluated in double like the scalar code */
+__attribute__((target("sse4.1")))
+static __m128 falloff_sse(__m128 x, __m128 y, __m128 z){
+    const __m128d c = _mm_set1_pd(0.6);
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128d lo = _mm_sub_pd(_mm_sub_pd(_mm_sub_pd(c, _mm_cvtps_pd(xx)), _mm_cvtps_pd(yy)), _mm_cvtps_pd(zz));
+    __m128d hi = _mm_sub_pd(_mm_sub_pd(_mm_sub_pd(c,
+        _mm_cvtps_pd(_mm_movehl_ps(xx, xx))), _mm_cvtps_pd(_mm_movehl_ps(yy, yy))), _mm_cvtps_pd(_mm_movehl_ps(zz, zz)));
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+/* x - 1.0 + 3.0*G3, evaluated in double like the scalar code */
+__attribute__((target("sse4.1")))
+static __m128 last_corner_sse(__m128 x, double g3){
+    const __m128d one = _mm_set1_pd(1.0), c = _mm_set1_pd(3.0*g3);
+    __m128d lo = _mm_add_pd(_mm_sub_pd(_mm_cvtps_pd(x), one), c);
+    __m128d hi = _mm_add_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), one), c);
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+__attribute__((target("sse4.1")))
+static __m128 contribution_sse(__m128 t, __m128 x, __m128 y, __m128 z, const int *gi){
+    __m128 gx = _mm_setr_ps(grad[gi[0]][0], grad[gi[1]][0], grad[gi[2]][0], grad[gi[3]][0]);
+    __m128 gy = _mm_setr_ps(grad[gi[0]][1], grad[gi[1]][1], grad[gi[2]][1], grad[gi[3]][1]);
+    __m128 gz = _mm_setr_ps(grad[gi[0]][2], grad[gi[1]][2], grad[gi[2]][2], grad[gi[3]][2]);
+    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, gx), _mm_mul_ps(y, gy)), _mm_mul_ps(z, gz));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 n = _mm_mul_ps(_mm_mul_ps(t2, t2), d);
+    return _mm_andnot_ps(_mm_cmplt_ps(t, _mm_setzero_ps()), n);
+}
+
+__attribute__((target("sse4.1")))
+static void noise_sse41(float scale, const float *px, const float *py, const float *pz, float *out, int count){
+    const float F3 = 1.0/3.0, G3 = 1.0/6.0;
+    const __m128 f3 = _mm_set1_ps(F3), g3 = _mm_set1_ps(G3), g3x2 = _mm_set1_ps(2.0*G3);
+    const __m128 s4 = _mm_set1_ps(scale), one = _mm_set1_ps(1.0f);
+    int n = 0;
+    for(; n + 4 <= count; n += 4){
+        __m128 xin = _mm_mul_ps(_mm_loadu_ps(px + n), s4);
+        __m128 yin = _mm_mul_ps(_mm_loadu_ps(py + n), s4);
+        __m128 zin = _mm_mul_ps(_mm_loadu_ps(pz + n), s4);
+        __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(xin, yin), zin), f3);
+        __m128i i = _mm_cvttps_epi32(_mm_add_ps(xin, s));
+        __m128i j = _mm_cvttps_epi32(_mm_add_ps(yin, s));
+        __m128i k = _mm_cvttps_epi32(_mm_add_ps(zin, s));
+        __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(i, j), k)), g3);
+        __m128 x0 = _mm_sub_ps(xin, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+        __m128 y0 = _mm_sub_ps(yin, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+        __m128 z0 = _mm_sub_ps(zin, _mm_sub_ps(_mm_cvtepi32_ps(k), t));
+
+        __m128 xy = _mm_cmpge_ps(x0, y0), yz = _mm_cmpge_ps(y0, z0), xz = _mm_cmpge_ps(x0, z0);
+        __m128 i1 = _mm_and_ps(_mm_and_ps(xy, _mm_or_ps(yz, xz)), one);
+        __m128 j1 = _mm_and_ps(_mm_andnot_ps(xy, yz), one);
+        __m128 k1 = _mm_andnot_ps(_mm_or_ps(yz, _mm_and_ps(xy, xz)), one);
+        __m128 i2 = _mm_and_ps(_mm_or_ps(xy, _mm_and_ps(yz, xz)), one);
+        __m128 j2 = _mm_andnot_ps(_mm_andnot_ps(yz, xy), one);
+        __m128 k2 = _mm_andnot_ps(_mm_and_ps(yz, _mm_or_ps(xy, xz)), one);
+
+        __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g3);
+        __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), g3);
+        __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, k1), g3);
+        __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, i2), g3x2);
+        __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, j2), g3x2);
+        __m128 z2 = _mm_add_ps(_mm_sub_ps(z0, k2), g3x2);
+        __m128 x3 = last_corner_sse(x0, G3);
+        __m128 y3 = last_corner_sse(y0, G3);
+        __m128 z3 = last_corner_sse(z0, G3);
+
+        int ii[4], jj[4], kk[4], o[6][4], gi[4][4], l;
+        float of[6][4];
+        _mm_storeu_si128((__m128i*)ii, _mm_and_si128(i, _mm_set1_epi32(255)));
+        _mm_storeu_si128((__m128i*)jj, _mm_and_si128(j, _mm_set1_epi32(255)));
+        _mm_storeu_si128((__m128i*)kk, _mm_and_si128(k, _mm_set1_epi32(255)));
+        _mm_storeu_ps(of[0], i1); _mm_storeu_ps(of[1], j1); _mm_storeu_ps(of[2], k1);
+        _mm_storeu_ps(of[3], i2); _mm_storeu_ps(of[4], j2); _mm_storeu_ps(of[5], k2);
+        for(l=0; l<4; l++){
+            int m;
+            for(m=0; m<6; m++) o[m][l] = (int)of[m][l];
+            gi[0][l] = perm[ii[l]+perm[jj[l]+perm[kk[l]]]] % 12;
+            gi[1][l] = perm[ii[l]+o[0][l]+perm[jj[l]+o[1][l]+perm[kk[l]+o[2][l]]]] % 12;
+            gi[2][l] = perm[ii[l]+o[3][l]+perm[jj[l]+o[4][l]+perm[kk[l]+o[5][l]]]] % 12;
+            gi[3][l] = perm[ii[l]+1+perm[jj[l]+1+perm[kk[l]+1]]] % 12;
+        }
+
+        __m128 sum = contribution_sse(falloff_sse(x0, y0, z0), x0, y0, z0, gi[0]);
+        sum = _mm_add_ps(sum, contribution_sse(falloff_sse(x1, y1, z1), x1, y1, z1, gi[1]));
+        sum = _mm_add_ps(sum, contribution_sse(falloff_sse(x2, y2, z2), x2, y2, z2, gi[2]));
+        sum = _mm_add_ps(sum, contribution_sse(falloff_sse(x3, y3, z3), x3, y3, z3, gi[3]));
+        __m128 value = _mm_add_ps(_mm_mul_ps(sum, _mm_set1_ps(16.0f)), one);
+        _mm_storeu_ps(out + n, _mm_add_ps(_mm_loadu_ps(out + n), value));
+    }
+    noise_scalar(scale, px + n, py + n, pz + n, out + n, count - n);
+}
+
+__attribute__((target("avx2")))
+static __m256 falloff_avx2(__m256 x, __m256 y, __m256 z){
+    const __m256d c = _mm256_set1_pd(0.6);
+    __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+    __m256d lo = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(c,
+        _mm256_cvtps_pd(_mm256_castps256_ps128(xx))), _mm256_cvtps_pd(_mm256_castps256_ps128(yy))), _mm256_cvtps_pd(_mm256_castps256_ps128(zz)));
+    __m256d hi = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(c,
+        _mm256_cvtps_pd(_mm256_extractf128_ps(xx, 1))), _mm256_cvtps_pd(_mm256_extractf128_ps(yy, 1))), _mm256_cvtps_pd(_mm256_extractf128_ps(zz, 1)));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+}
+
+__attribute__((target("avx2")))
+static __m256 last_corner_avx2(__m256 x, double g3){
+    const __m256d one = _mm256_set1_pd(1.0), c = _mm256_set1_pd(3.0*g3);
+    __m256d lo = _mm256_add_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), one), c);
+    __m256d hi = _mm256_add_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), one), c);
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+}
+
+/* perm[ii+di+perm[jj+dj+perm[kk+dk]]] % 12, with x % 12 == (x * 43691) >> 19 for 0 <= x < 512 */
+__attribute__((target("avx2")))
+static __m256i gradient_index_avx2(__m256i ii, __m256i jj, __m256i kk){
+    __m256i p = _mm256_i32gather_epi32(perm, kk, 4);
+    p = _mm256_i32gather_epi32(perm, _mm256_add_epi32(jj, p), 4);
+    p = _mm256_i32gather_epi32(perm, _mm256_add_epi32(ii, p), 4);
+    __m256i q = _mm256_srli_epi32(_mm256_mullo_epi32(p, _mm256_set1_epi32(43691)), 19);
+    return _mm256_sub_epi32(p, _mm256_mullo_epi32(q, _mm256_set1_epi32(12)));
+}
+
+__attribute__((target("avx2")))
+static __m256 contribution_avx2(__m256 t, __m256 x, __m256 y, __m256 z, __m256i gi){
+    const float *g = &grad[0][0];
+    __m256i gi3 = _mm256_mullo_epi32(gi, _mm256_set1_epi32(3));
+    __m256 gx = _mm256_i32gather_ps(g, gi3, 4);
+    __m256 gy = _mm256_i32gather_ps(g + 1, gi3, 4);
+    __m256 gz = _mm256_i32gather_ps(g + 2, gi3, 4);
+    __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, gx), _mm256_mul_ps(y, gy)), _mm256_mul_ps(z, gz));
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 n = _mm256_mul_ps(_mm256_mul_ps(t2, t2), d);
+    return _mm256_andnot_ps(_mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_LT_OQ), n);
+}
+
+__attribute__((target("avx2")))
+static void noise_avx2(float scale, const float *px, const float *py, const float *pz, float *out, int count){
+    const float F3 = 1.0/3.0, G3 = 1.0/6.0;
+    const __m256 f3 = _mm256_set1_ps(F3), g3 = _mm256_set1_ps(G3), g3x2 = _mm256_set1_ps(2.0*G3);
+    const __m256 s8 = _mm256_set1_ps(scale), one = _mm256_set1_ps(1.0f);
+    const __m256i mask = _mm256_set1_epi32(255), ione = _mm256_set1_epi32(1);
+    int n = 0;
+    for(; n + 8 <= count; n += 8){
+        __m256 xin = _mm256_mul_ps(_mm256_loadu_ps(px + n), s8);
+        __m256 yin = _mm256_mul_ps(_mm256_loadu_ps(py + n), s8);
+        __m256 zin = _mm256_mul_ps(_mm256_loadu_ps(pz + n), s8);
+        __m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(xin, yin), zin), f3);
+        __m256i i = _mm256_cvttps_epi32(_mm256_add_ps(xin, s));
+        __m256i j = _mm256_cvttps_epi32(_mm256_add_ps(yin, s));
+        __m256i k = _mm256_cvttps_epi32(_mm256_add_ps(zin, s));
+        __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(i, j), k)), g3);
+        __m256 x0 = _mm256_sub_ps(xin, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+        __m256 y0 = _mm256_sub_ps(yin, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+        __m256 z0 = _mm256_sub_ps(zin, _mm256_sub_ps(_mm256_cvtepi32_ps(k), t));
+
+        __m256 xy = _mm256_cmp_ps(x0, y0, _CMP_GE_OQ);
+        __m256 yz = _mm256_cmp_ps(y0, z0, _CMP_GE_OQ);
+        __m256 xz = _mm256_cmp_ps(x0, z0, _CMP_GE_OQ);
+        __m256 i1 = _mm256_and_ps(_mm256_and_ps(xy, _mm256_or_ps(yz, xz)), one);
+        __m256 j1 = _mm256_and_ps(_mm256_andnot_ps(xy, yz), one);
+        __m256 k1 = _mm256_andnot_ps(_mm256_or_ps(yz, _mm256_and_ps(xy, xz)), one);
+        __m256 i2 = _mm256_and_ps(_mm256_or_ps(xy, _mm256_and_ps(yz, xz)), one);
+        __m256 j2 = _mm256_andnot_ps(_mm256_andnot_ps(yz, xy), one);
+        __m256 k2 = _mm256_andnot_ps(_mm256_and_ps(yz, _mm256_or_ps(xy, xz)), one);
+
+        __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, i1), g3);
+        __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, j1), g3);
+        __m256 z1 = _mm256_add_ps(_mm256_sub_ps(z0, k1), g3);
+        __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, i2), g3x2);
+        __m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, j2), g3x2);
+        __m256 z2 = _mm256_add_ps(_mm256_sub_ps(z0, k2), g3x2);
+        __m256 x3 = last_corner_avx2(x0, G3);
+        __m256 y3 = last_corner_avx2(y0, G3);
+        __m256 z3 = last_corner_avx2(z0, G3);
+
+        __m256i ii = _mm256_and_si256(i, mask), jj = _mm256_and_si256(j, mask), kk = _mm256_and_si256(k, mask);
+        __m256i gi0 = gradient_index_avx2(ii, jj, kk);
+        __m256i gi1 = gradient_index_avx2(_mm256_add_epi32(ii, _mm256_cvttps_epi32(i1)),
+                                          _mm256_add_epi32(jj, _mm256_cvttps_epi32(j1)),
+                                          _mm256_add_epi32(kk, _mm256_cvttps_epi32(k1)));
+        __m256i gi2 = gradient_index_avx2(_mm256_add_epi32(ii, _mm256_cvttps_epi32(i2)),
+                                          _mm256_add_epi32(jj, _mm256_cvttps_epi32(j2)),
+                                          _mm256_add_epi32(kk, _mm256_cvttps_epi32(k2)));
+        __m256i gi3 = gradient_index_avx2(_mm256_add_epi32(ii, ione), _mm256_add_epi32(jj, ione), _mm256_add_epi32(kk, ione));
+
+        __m256 sum = contribution_avx2(falloff_avx2(x0, y0, z0), x0, y0, z0, gi0);
+        sum = _mm256_add_ps(sum, contribution_avx2(falloff_avx2(x1, y1, z1), x1, y1, z1, gi1));
+        sum = _mm256_add_ps(sum, contribution_avx2(falloff_avx2(x2, y2, z2), x2, y2, z2, gi2));
+        sum = _mm256_add_ps(sum, contribution_avx2(falloff_avx2(x3, y3, z3), x3, y3, z3, gi3));
+        __m256 value = _mm256_add_ps(_mm256_mul_ps(sum, _mm256_set1_ps(16.0f)), one);
+        _mm256_storeu_ps(out + n, _mm256_add_ps(_mm256_loadu_ps(out + n), value));
+    }
+    noise_scalar(scale, px + n, py + n, pz + n, out + n, count - n);
+}
+#endif
+
+static noise_kernel kernel = noise_scalar;
+static const char *kernel_name = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/* runs once, through pthread_once, before the first use of kernel on any thread */
+static void select_kernel(void){
+#ifdef SIMPLEX_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        kernel = noise_avx2;
+        kernel_name = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse4.1")){
+        kernel = noise_sse41;
+        kernel_name = "sse4.1";
+    }
+#endif
+}
+
+void simplex_noise_batch(int octaves, const float *x, const float *y, const float *z, float *out, int count){
+    float scale = 1.0;
+    int i;
+    pthread_once(&kernel_once, select_kernel);
+    for(i=0; i<count; i++){
+        out[i] = 0.0;
+    }
+    for(i=0; i<octaves; i++){
+        kernel(scale, x, y, z, out, count);
+        scale *= 2;
+    }
+}
+
+const char *simplex_noise_kernel(void){
+    pthread_once(&kernel_once, select_kernel);
+    return kernel_name;
+}
+
+int simplex_noise_use_kernel(const char *name){
+    pthread_once(&kernel_once, select_kernel);
+    if(strcmp(name, "scalar") == 0){
+        kernel = noise_scalar;
+        kernel_name = "scalar";
+        return 1;
+    }
+#ifdef SIMPLEX_X86
+    if(strcmp(name, "sse4.1") == 0 && __builtin_cpu_supports("sse4.1")){
+        kernel = noise_sse41;
+        kernel_name = "sse4.1";
+        return 1;
+    }
+    if(strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")){
+        kernel = noise_avx2;
+        kernel_name = "avx2";
+        return 1;
+    }
+#endif
+    return 0;
+}
@@ -7,6 +7,16 @@ extern "C" {
 
 float simplex_noise(int octaves, float x, float y, float z);
 
+/* out[i] = simplex_noise(octaves, x[i], y[i], z[i]) for i < count. Uses the widest
+   SIMD kernel the CPU supports; every kernel gives bit-for-bit the scalar result. */
+void simplex_noise_batch(int octaves, const float *x, const float *y, const float *z, float *out, int count);
+
+/* name of the kernel simplex_noise_batch uses: "avx2", "sse4.1" or "scalar" */
+const char *simplex_noise_kernel(void);
+/* forces a kernel by name, returns 0 if it is unknown or unsupported here; not
+   safe while other threads are generating noise */
+int simplex_noise_use_kernel(const char *name);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,206 @@
+#include "terrain.h"
+#include "simplex.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace Glube {
+
+namespace {
+
+// noise space coordinates of a voxel, exactly as the per-voxel generator computes them
+inline float noiseX(int x, int hs, long ix) { return x / (float)hs/2 + ix + 500; }
+inline float noiseY(int y, int size, long iy) { return y / (float)size + iy + 500; }
+
+// Bounds of simplex_noise() with one octave, whatever the input. It returns
+// 16 * (n0 + n1 + n2 + n3) + 1, and with the worst gradient at every corner each
+// term is at most t^4 times the sum of the two largest components of the corner's
+// offset. A branch and bound search over the skewed cell, and the cell on either
+// side for inputs truncated towards zero, keeps that sum under 0.03159, so the
+// noise lies within 1 +- 0.5054. The rest is margin for float rounding and for
+// interpolating between lattice samples, which stays within the samples' range.
+const float NOISE_MIN = 0.49f;
+const float NOISE_MAX = 1.51f;
+
+// Noise for one (x, y) row of a chunk, all z at once. Rows are only asked for
+// with y in [yBegin, yEnd), so the lattice is sampled just around those.
+class RowSampler
+{
+public:
+    RowSampler(const int *spacing_, long ix_, long iy_, long iz_, int size_, int yBegin, int yEnd):
+        spacing(spacing_), ix(ix_), iy(iy_), iz(iz_), size(size_), hs(size_ / 2),
+        nx(size_), ny(size_), nz(size_)
+    {
+        for(int z = -hs; z < hs; ++z) {
+            nz[z + hs] = noiseX(z, hs, iz);
+        }
+        if(!exact() && yBegin < yEnd) sampleLattice(yBegin, yEnd);
+    }
+
+    bool exact() const
+    {
+        return spacing[0] == 1 && spacing[1] == 1 && spacing[2] == 1;
+    }
+
+    void exactRow(int x, int y, float *n)
+    {
+        std::fill(nx.begin(), nx.end(), noiseX(x, hs, ix));
+        std::fill(ny.begin(), ny.end(), noiseY(y, size, iy));
+        simplex_noise_batch(1, &nx[0], &ny[0], &nz[0], n, size);
+    }
+
+    void row(int x, int y, float *n)
+    {
+        if(exact()) {
+            exactRow(x, y, n);
+            return;
+        }
+
+        // bilinear in x and y down to one line of lattice values along z, then linear in z
+        const int lx = x + hs, ly = y;
+        const int a = lx / spacing[0], b = ly / spacing[1];
+        const float fx = (lx % spacing[0]) / (float)spacing[0];
+        const float fy = (ly % spacing[1]) / (float)spacing[1];
+        const float *l00 = &lattice[(a * count[1] + b) * count[2]];
+        const float *l01 = l00 + count[2];
+        const float *l10 = l00 + count[1] * count[2];
+        const float *l11 = l10 + count[2];
+        for(int c = 0; c < count[2]; ++c) {
+            const float v0 = l00[c] + (l10[c] - l00[c]) * fx;
+            const float v1 = l01[c] + (l11[c] - l01[c]) * fx;
+            line[c] = v0 + (v1 - v0) * fy;
+        }
+        for(int lz = 0; lz < size; ++lz) {
+            const int c = lz / spacing[2];
+            const float fz = (lz % spacing[2]) / (float)spacing[2];
+            n[lz] = line[c] + (line[c + 1] - line[c]) * fz;
+        }
+    }
+
+private:
+    void sampleLattice(int yBegin, int yEnd)
+    {
+        for(int i = 0; i < 3; ++i) {
+            count[i] = (size + spacing[i] - 1) / spacing[i] + 1;
+        }
+        lattice.resize(count[0] * count[1] * count[2]);
+        line.resize(count[2]);
+
+        std::vector<float> lx(count[2]), ly(count[2]), lz(count[2]);
+        for(int c = 0; c < count[2]; ++c) {
+            lz[c] = noiseX(-hs + c * spacing[2], hs, iz);
+        }
+        // the lattice rows either side of the rows asked for
+        const int bBegin = yBegin / spacing[1], bEnd = (yEnd - 1) / spacing[1] + 2;
+        for(int a = 0; a < count[0]; ++a) {
+            std::fill(lx.begin(), lx.end(), noiseX(-hs + a * spacing[0], hs, ix));
+            for(int b = bBegin; b < bEnd; ++b) {
+                std::fill(ly.begin(), ly.end(), noiseY(b * spacing[1], size, iy));
+                simplex_noise_batch(1, &lx[0], &ly[0], &lz[0], &lattice[(a * count[1] + b) * count[2]], count[2]);
+            }
+        }
+    }
+
+    const int *spacing;
+    long ix, iy, iz;
+    int size, hs;
+    std::vector<float> nx, ny, nz;
+
+    int count[3];
+    std::vector<float> lattice, line;
+};
+
+inline float heightFalloff(int y, int size)
+{
+    //const float hf = (y < size/2 ? 1 : 1 - (y - size/2) / (float)(size / 2));
+    return pow((1 - y/(float)size) * 2, 2);
+}
+
+// The density test n * hf > 1 settles the layers at either end without noise: hf
+// falls with y, so it holds for any noise low down and for none high up. Float
+// multiplication rounds monotonically, so testing the bounds exactly as voxels are
+// tested gives the same answer for every voxel.
+void settledLayers(int size, int &airEnd, int &solidBegin)
+{
+    airEnd = 0;
+    while(airEnd < size && NOISE_MIN * heightFalloff(airEnd, size) > 1.0f) ++airEnd;
+    solidBegin = size;
+    while(solidBegin > airEnd && !(NOISE_MAX * heightFalloff(solidBegin - 1, size) > 1.0f)) --solidBegin;
+}
+
+}
+
+TerrainGenerator::TerrainGenerator()
+{
+    setLatticeSpacing(1, 1, 1);
+}
+
+void TerrainGenerator::setLatticeSpacing(int x, int y, int z)
+{
+    spacing[0] = std::max(1, x);
+    spacing[1] = std::max(1, y);
+    spacing[2] = std::max(1, z);
+}
+
+bool TerrainGenerator::isExact() const
+{
+    return spacing[0] == 1 && spacing[1] == 1 && spacing[2] == 1;
+}
+
+void TerrainGenerator::noiseLayers(int size, int &first, int &end) const
+{
+    settledLayers(size, first, end);
+}
+
+void TerrainGenerator::generate(long ix, long iy, long iz, int size, Chunk::BlockType *blocks) const
+{
+    int airEnd, solidBegin;
+    settledLayers(size, airEnd, solidBegin);
+    RowSampler sampler(spacing, ix, iy, iz, size, airEnd, solidBegin);
+    std::vector<float> n(size);
+    for(int x = 0; x < size; ++x) {
+        for(int y = 0; y < size; ++y) {
+            if(y < airEnd || y >= solidBegin) {
+                const Chunk::BlockType b = y < airEnd ? 0 : 1;
+                for(int z = 0; z < size; ++z) {
+                    blocks[x + y * size + z * size * size] = b;
+                }
+                continue;
+            }
+            sampler.row(x - size/2, y, &n[0]);
+            const float hf = heightFalloff(y, size);
+            for(int z = 0; z < size; ++z) {
+                blocks[x + y * size + z * size * size] = n[z] * hf > 1.0f ? 0 : 1;
+            }
+        }
+    }
+}
+
+TerrainGenerator::Difference TerrainGenerator::compareToExact(long ix, long iy, long iz, int size) const
+{
+    RowSampler sampler(spacing, ix, iy, iz, size, 0, size);
+    std::vector<float> n(size), exact(size);
+    Difference diff = { 0, 0, 0.0f, 0.0 };
+    for(int x = 0; x < size; ++x) {
+        for(int y = 0; y < size; ++y) {
+            sampler.row(x - size/2, y, &n[0]);
+            sampler.exactRow(x - size/2, y, &exact[0]);
+            const float hf = heightFalloff(y, size);
+            for(int z = 0; z < size; ++z) {
+                const float error = std::fabs(n[z] - exact[z]);
+                diff.maxNoiseError = std::max(diff.maxNoiseError, error);
+                diff.meanNoiseError += error;
+                if((n[z] * hf > 1.0f) != (exact[z] * hf > 1.0f))
+                    diff.mismatched++;
+            }
+        }
+    }
+    diff.voxels = (std::size_t)size * size * size;
+    diff.meanNoiseError /= diff.voxels;
+    return diff;
+}
+
+}
@@ -0,0 +1,40 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "chunk.h"
+
+namespace Glube {
+
+// Fills chunk block data from simplex noise. By default noise is evaluated at
+// every voxel; with a lattice spacing it is sampled every few voxels per axis
+// and trilinearly interpolated in between. Spacings that divide the chunk size
+// keep neighbouring chunks seamless, since they share their border samples.
+class TerrainGenerator
+{
+public:
+    TerrainGenerator();
+
+    void setLatticeSpacing(int x, int y, int z);
+    bool isExact() const;
+
+    // Layers [first, end) of a chunk are the only ones that need noise: every block
+    // below them is air and every block from end up is solid, for any chunk.
+    void noiseLayers(int size, int &first, int &end) const;
+    // blocks is size^3, laid out like Chunk: (x + size/2) + y * size + (z + size/2) * size * size
+    void generate(long ix, long iy, long iz, int size, Chunk::BlockType *blocks) const;
+
+    struct Difference {
+        std::size_t voxels;
+        std::size_t mismatched;  // voxels whose block differs from the exact mode
+        float maxNoiseError;
+        double meanNoiseError;
+    };
+    // how far this generator's output for one chunk is from evaluating noise at every voxel
+    Difference compareToExact(long ix, long iy, long iz, int size) const;
+
+private:
+    int spacing[3];
+};
+
+}
+#endif // TERRAIN_H
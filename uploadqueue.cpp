@@ -0,0 +1,33 @@
+#include "uploadqueue.h"
+
+namespace Glube {
+
+UploadQueue::UploadQueue():
+    requests(),
+    budgetBytes(0),
+    budgetMs(0)
+{
+}
+
+UploadQueue::~UploadQueue()
+{
+}
+
+void UploadQueue::setBudget(std::size_t bytes, double milliseconds)
+{
+    budgetBytes = bytes;
+    budgetMs = milliseconds;
+}
+
+void UploadQueue::request(Chunk *chunk, float distance)
+{
+    Request r = { chunk, distance };
+    requests.push_back(r);
+}
+
+std::size_t UploadQueue::pending() const
+{
+    return requests.size();
+}
+
+}
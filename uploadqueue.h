@@ -0,0 +1,44 @@
+#ifndef UPLOADQUEUE_H
+#define UPLOADQUEUE_H
+
+#include <cstddef>
+#include <vector>
+
+namespace Glube {
+
+class Chunk;
+
+// Meshes waiting to be uploaded. Chunks are requested every frame with their
+// distance from the camera; drain() uploads the nearest first until the byte or
+// time budget for the frame runs out, always at least one. Until its new mesh is
+// uploaded a chunk keeps drawing the old one. The requests are kept here; the
+// uploading is done by a subclass, GLUploadQueue for a GLBufferArena.
+class UploadQueue
+{
+public:
+    UploadQueue();
+    virtual ~UploadQueue();
+
+    // 0 for either means no limit of that kind
+    void setBudget(std::size_t bytes, double milliseconds);
+
+    void request(Chunk *chunk, float distance);
+    std::size_t pending() const;
+    // returns the number of meshes uploaded and forgets the rest
+    virtual std::size_t drain() = 0;
+
+protected:
+    struct Request {
+        Chunk *chunk;
+        float distance;
+        bool operator<(const Request &other) const { return distance < other.distance; }
+    };
+
+    std::vector<Request> requests;
+    std::size_t budgetBytes;
+    double budgetMs;
+};
+
+}
+
+#endif // UPLOADQUEUE_H
@@ -1,17 +1,25 @@
-#version 120
-attribute vec3 vertex;
-attribute vec3 normalVec;
+#version 330 core
+// xyz: corner position, w: face index (low 3 bits) + block type * 8
+in vec4 vertex;
+// position of the chunk's corner, one value per draw
+in vec3 chunkOffset;
 
 uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
 
-varying vec3 position;
-varying vec3 norm;
+out vec3 position;
+out vec3 norm;
+
+const vec3 faceNormals[6] = vec3[6](
+    vec3(-1, 0, 0), vec3(1, 0, 0),
+    vec3(0, -1, 0), vec3(0, 1, 0),
+    vec3(0, 0, -1), vec3(0, 0, 1)
+);
 
 void main() {
-    position = vertex;
-    norm = normalVec;
+    position = vertex.xyz + chunkOffset;
+    norm = faceNormals[int(mod(vertex.w, 8.0))];
     //norm = vec3(0, 0, 1);
     gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(position, 1.0);
 }
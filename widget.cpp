@@ -1,8 +1,9 @@
 #include "widget.h"
 
-#include <QTimer>
 #include <QGLShader>
 #include <QFile>
+#include <QDir>
+#include <QDateTime>
 #include <QDebug>
 #include <QCursor>
 #include <QApplication>
@@ -13,10 +14,15 @@
 #include <boost/shared_ptr.hpp>
 using boost::shared_ptr;
 
+// the simulation's fixed step; frames are drawn as fast as the display takes them
 const float UpdatePeriod = 0.02;
+// after a longer stall the simulation skips ahead instead of catching up
+const int MAX_STEPS_PER_FRAME = 10;
+// simulation steps per day
+const int CLOCK_MAX = 1024;
 const float FoV = M_PI / 4;
-const float RenderDistance = 400;
-const float FogStart = 350;
+const float RenderDistance = 800;
+const float FogStart = 700;
 const float LoadBufferDistance = 100;
 
 const float SPEED = 20;
@@ -24,25 +30,84 @@ const float RSPEED = M_PI / 2;
 const float MOUSE_RSPEED = M_PI / 2 / 200;
 const float MAX_PITCH = M_PI / 2 * 0.9;
 const float CHUNK_SIZE = 128;
+const float ChunkDiag = CHUNK_SIZE/2.0f * 1.414;
 const float GRAVITY = -10;
 const float JETPACK = 20;
+const Glube::Chunk::MeshMode MESH_MODE = Glube::Chunk::GreedyMesh;
+// chunks beyond this are meshed at half resolution, beyond twice it at a quarter
+const float LOD_DISTANCE = 200;
+// voxels between noise samples per axis (x, y, z); 1 evaluates noise at every voxel
+const int NOISE_LATTICE[3] = { 1, 1, 1 };
+const char *WORLD_DIRECTORY = ".glube/world"; // relative to the home directory
+const std::size_t MEMORY_BUDGET = 512 * 1024 * 1024; // resident map node bytes before eviction
+const std::size_t ARENA_VERTICES = 4 * 1024 * 1024; // initial size of the chunk mesh arena
+// chunk meshes uploaded per frame, nearest first; at least one always goes
+const std::size_t UPLOAD_BUDGET_BYTES = 2 * 1024 * 1024;
+const double UPLOAD_BUDGET_MS = 4;
+// software depth buffer for occlusion culling, and how near a chunk has to be to hide others
+const int OCCLUSION_WIDTH = 256, OCCLUSION_HEIGHT = 128;
+const float OCCLUDER_DISTANCE = CHUNK_SIZE * 1.5;
+const GLuint VERTEX_ATTRIB = 0, OFFSET_ATTRIB = 1;
+// the profiling overlay shows means over the last frames, updated every few frames;
+// exports go next to the world
+const std::size_t PROFILE_SUMMARY_FRAMES = 50, PROFILE_REFRESH_FRAMES = 25;
+const char *PROFILE_DIRECTORY = ".glube"; // relative to the home directory
+
+// the renderer sticks to the core profile: no quads, no fixed function
+static QGLFormat coreFormat()
+{
+    QGLFormat format(QGL::DoubleBuffer | QGL::DepthBuffer | QGL::Rgba);
+    format.setVersion(3, 3);
+    format.setProfile(QGLFormat::CoreProfile);
+    format.setSwapInterval(1);
+    return format;
+}
 
 Widget::Widget(QWidget *parent) :
-    QGLWidget(QGLFormat(QGL::DoubleBuffer | QGL::DepthBuffer | QGL::Rgba ), parent),
-    vao(),
-    yawRate(0),
-    jets(false),
-    activeCam(0),
-    nodeFactory(CHUNK_SIZE)
+    QGLWidget(coreFormat(), parent),
+    input(),
+    renderThread(*this),
+    rendering(false),
+    steps(0),
+    arena(sizeof(Glube::Chunk::Vertex), ARENA_VERTICES),
+    uploads(arena),
+    batch(),
+    renderer(arena),
+    nodeFactory(CHUNK_SIZE),
+    grid(nodeFactory, RenderDistance + LoadBufferDistance + ChunkDiag),
+    occlusion(OCCLUSION_WIDTH, OCCLUSION_HEIGHT),
+    visibilityFrame(0),
+    gpuDraw("gpu draw ms"),
+    overlay(),
+    showProfile(false)
 {
+    input.motion = glm::vec3(0.0f);
+    input.yawRate = input.mouseYaw = input.mousePitch = 0;
+    input.jets = input.resized = false;
+    input.activeCam = input.width = input.height = 0;
+    for(int i = 0; i < 3; ++i) {
+        previousPosition[i] = glm::vec3(0.0f);
+        previousYaw[i] = 0;
+    }
+    setAutoBufferSwap(false);
+
+    nodeFactory.setMeshMode(MESH_MODE);
+    nodeFactory.setLodDistance(LOD_DISTANCE);
+    nodeFactory.setWorldDirectory(QDir::home().filePath(WORLD_DIRECTORY));
+    nodeFactory.setMemoryBudget(MEMORY_BUDGET);
+    uploads.setBudget(UPLOAD_BUDGET_BYTES, UPLOAD_BUDGET_MS);
+    Glube::TerrainGenerator &generator = nodeFactory.getTerrainGenerator();
+    generator.setLatticeSpacing(NOISE_LATTICE[0], NOISE_LATTICE[1], NOISE_LATTICE[2]);
+    if(!generator.isExact()) {
+        Glube::TerrainGenerator::Difference diff = generator.compareToExact(0, 0, 0, CHUNK_SIZE);
+        qDebug() << "Noise lattice" << NOISE_LATTICE[0] << NOISE_LATTICE[1] << NOISE_LATTICE[2] << ":"
+                 << diff.mismatched << "of" << diff.voxels << "blocks differ from exact terrain,"
+                 << "noise error max" << diff.maxNoiseError << "mean" << diff.meanNoiseError;
+    }
+
     //srand(QDateTime::currentMSecsSinceEpoch());
     srand(2);
 
-    QTimer *t = new QTimer(this);
-    connect(t, SIGNAL(timeout()), this, SLOT(updateGL()));
-    t->setInterval(1000 * UpdatePeriod);
-    t->start();
-
     setMouseTracking(true);
     setCursor( QCursor( Qt::BlankCursor ) );
     setFocusPolicy(Qt::StrongFocus);
@@ -51,23 +116,108 @@ Widget::Widget(QWidget *parent) :
 
 Widget::~Widget()
 {
-    makeCurrent(); // so context is current for vao/chunk etc destructors
+    rendering = false;
+    renderThread.wait();
+    makeCurrent(); // so context is current for vertex array/chunk etc destructors
+}
+
+RenderThread::RenderThread(Widget &widget_):
+    widget(widget_)
+{
+}
+
+void RenderThread::run()
+{
+    widget.renderLoop();
+}
+
+void Widget::showEvent(QShowEvent *e)
+{
+    QGLWidget::showEvent(e);
+    if(rendering) return;
+    {
+        boost::mutex::scoped_lock lock(inputMutex);
+        input.width = width();
+        input.height = height();
+        input.resized = true;
+    }
+    // from here on only the render thread touches the context
+    rendering = true;
+    doneCurrent();
+#if QT_VERSION >= 0x050000
+    context()->moveToThread(&renderThread);
+#endif
+    renderThread.start();
+}
+
+void Widget::paintEvent(QPaintEvent *)
+{
+}
+
+void Widget::resizeEvent(QResizeEvent *e)
+{
+    boost::mutex::scoped_lock lock(inputMutex);
+    input.width = e->size().width();
+    input.height = e->size().height();
+    input.resized = true;
+}
+
+void Widget::renderLoop()
+{
+    makeCurrent();
+    initializeGL();
+
+    QElapsedTimer clock;
+    clock.start();
+    qint64 last = 0;
+    double lag = 0;
+    while(rendering) {
+        Input in;
+        {
+            boost::mutex::scoped_lock lock(inputMutex);
+            in = input;
+            input.mouseYaw = input.mousePitch = 0;
+            input.resized = false;
+        }
+        if(in.resized) resizeGL(in.width, in.height);
+
+        // mouse look isn't simulated, it turns the camera straight away
+        Glube::Camera &c = cam[in.activeCam];
+        c.setYaw(c.getYaw() + in.mouseYaw);
+        c.setPitch(std::min(MAX_PITCH, std::max(-MAX_PITCH, c.getPitch() + in.mousePitch)));
+        previousYaw[in.activeCam] += in.mouseYaw;
+
+        const qint64 now = clock.nsecsElapsed();
+        lag = std::min(lag + (now - last) / 1e9, (double)UpdatePeriod * MAX_STEPS_PER_FRAME);
+        last = now;
+        while(lag >= UpdatePeriod) {
+            simulate(in);
+            lag -= UpdatePeriod;
+        }
+        renderFrame(in, lag / UpdatePeriod);
+        // waits for the display's next frame
+        swapBuffers();
+    }
+
+    doneCurrent();
+#if QT_VERSION >= 0x050000
+    context()->moveToThread(qApp->thread());
+#endif
 }
 
 void Widget::initializeGL()
 {
     LoadShaders();
 
-    vao.allocate();
-
     glClearColor(0.0, 0.0, 0.0, 0.0);
     glEnable(GL_DEPTH_TEST);
-    //glEnable(GL_CULL_FACE);
+    glEnable(GL_CULL_FACE);
 
     currentMapNode = nodeFactory.getMapNode(0, 0);
     currentMapNode->build();
 
     cam[0].setPosition(glm::vec3(0, CHUNK_SIZE / 2.0f + 2, 0));
+    previousPosition[0] = cam[0].getPosition();
 
     shaderProg.setUniformValue("RenderDistance", RenderDistance);
     shaderProg.setUniformValue("FogStart", FogStart);
@@ -78,34 +228,27 @@ void Widget::resizeGL(int w, int h)
     if(w > 0 && h > 0)
     {
         glViewport(0, 0, (GLint)w, (GLint)h);
-        glm::mat4 projectionMatrix = glm::perspective(FoV, static_cast<float>(w)/h, 0.1f, RenderDistance);
+        projection = glm::perspective(FoV, static_cast<float>(w)/h, 0.1f, RenderDistance);
         int pLoc = shaderProg.uniformLocation("projectionMatrix");
-        glUniformMatrix4fv(pLoc, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        glUniformMatrix4fv(pLoc, 1, GL_FALSE, glm::value_ptr(projection));
     }
 }
 
-void Widget::paintGL()
+void Widget::simulate(const Input &in)
 {
-    static int clock = 0;
-    static const int CLOCK_MAX = 1024;
-    clock = (clock + 1) % CLOCK_MAX;
-
-    float l = sin(clock / (float)CLOCK_MAX * M_PI * 2) / 2 + 0.5;
-    int clockLoc = shaderProg.uniformLocation("clock");
-    glUniform1f(clockLoc, l);
-
-    glClearColor(135/255.0 * l, 196/255.0 * l, 250 / 255.0 * l, 1.0);
-    //glClearColor(1.0, 1.0, 1.0, 1.0);
-
-    vao.bind();
-
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    Glube::Profiler::Scope scope("simulate");
+    for(int i = 0; i < 3; ++i) {
+        previousPosition[i] = cam[i].getPosition();
+        previousYaw[i] = cam[i].getYaw();
+    }
+    ++steps;
 
     // position
-    float yaw = fmod(cam[activeCam].getYaw() + yawRate * RSPEED * UpdatePeriod, M_PI * 2);
+    const int activeCam = in.activeCam;
+    float yaw = fmod(cam[activeCam].getYaw() + in.yawRate * RSPEED * UpdatePeriod, M_PI * 2);
     glm::mat4 yawMatrix = glm::rotate(glm::mat4(1.0f), -yaw, glm::vec3(0, 1, 0));
 
-    glm::vec4 delta(motion * SPEED * UpdatePeriod, 1.0);
+    glm::vec4 delta(in.motion * SPEED * UpdatePeriod, 1.0);
     delta = glm::transpose(yawMatrix) * delta;
 
     glm::vec3 newPos = cam[activeCam].getPosition();
@@ -117,19 +260,24 @@ void Widget::paintGL()
         newPos.y = std::min((float)CHUNK_SIZE * 2, std::max(newPos.y + delta.y, 0.0f));
         newPos.z += delta.z;
 
+        // positions are relative to the current node, the previous one too so the
+        // frames drawn in between don't jump
+        glm::vec3 shift(0.0f);
         if(newPos.z > CHUNK_SIZE / 2) {
-            newPos.z += -CHUNK_SIZE;
+            shift.z = -CHUNK_SIZE;
             newMapNode = newMapNode->getNext(Glube::MapNode::SOUTH);
         } else if(newPos.z < -CHUNK_SIZE / 2) {
-            newPos.z += CHUNK_SIZE;
+            shift.z = CHUNK_SIZE;
             newMapNode = newMapNode->getNext(Glube::MapNode::NORTH);
         } else if(newPos.x > CHUNK_SIZE / 2) {
-            newPos.x += -CHUNK_SIZE;
+            shift.x = -CHUNK_SIZE;
             newMapNode = newMapNode->getNext(Glube::MapNode::EAST);
         } else if(newPos.x < -CHUNK_SIZE / 2) {
-            newPos.x += CHUNK_SIZE;
+            shift.x = CHUNK_SIZE;
             newMapNode = newMapNode->getNext(Glube::MapNode::WEST);
         }
+        newPos += shift;
+        previousPosition[activeCam] += shift;
 
         /*
         float accel = (GRAVITY + (jets ? JETPACK : 0)) * UpdatePeriod;
@@ -159,88 +307,187 @@ void Widget::paintGL()
         newPos.y += delta.y;
         newPos.z += delta.z;
     }
-    // camera
     cam[activeCam].setPosition(newPos);
     cam[activeCam].setYaw(yaw);
-    cam[activeCam].setView(shaderProg);
+}
+
+void Widget::renderFrame(const Input &in, float alpha)
+{
+    Glube::Profiler::instance().nextFrame();
+    Glube::Profiler::Scope paintScope("paint");
+
+    float l = sin(fmod(steps + alpha, CLOCK_MAX) / CLOCK_MAX * M_PI * 2) / 2 + 0.5;
+    int clockLoc = shaderProg.uniformLocation("clock");
+    glUniform1f(clockLoc, l);
+
+    glClearColor(135/255.0 * l, 196/255.0 * l, 250 / 255.0 * l, 1.0);
+    //glClearColor(1.0, 1.0, 1.0, 1.0);
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // cameras alpha of the way from the previous simulation step to the last
+    for(int i = 0; i < 3; ++i) {
+        float turn = fmod(cam[i].getYaw() - previousYaw[i], M_PI * 2);
+        if(turn > M_PI) turn -= M_PI * 2;
+        if(turn < -M_PI) turn += M_PI * 2;
+        view[i].setPosition(glm::mix(previousPosition[i], cam[i].getPosition(), alpha));
+        view[i].setYaw(previousYaw[i] + turn * alpha);
+        view[i].setPitch(cam[i].getPitch());
+    }
+    const int activeCam = in.activeCam;
+    view[activeCam].setView(shaderProg);
 
     // draw
     glm::mat4 modelMatrix(1.0f);
-    glm::mat4 view = cam[0].viewMatrix();
-
-    const float ChunkDiag = CHUNK_SIZE/2.0f * 1.414;
-
-    Glube::MapNode::List nodes, filteredNodes;
-    currentMapNode->findRecursive(glm::vec3(0, 0, 0), RenderDistance + LoadBufferDistance + ChunkDiag, nodes);
-    foreach(Glube::MapNode* n, nodes) {
-        n->startBuild();
-        glm::vec4 camPos = view * glm::vec4(n->pos(), 1.0f);
-        glm::vec2 cp(camPos.x, camPos.z);
-        // additional angle based on distance
-        double angle = atan2(ChunkDiag, glm::length(cp));
-        if(glm::length(cp) < ChunkDiag
-           || (glm::acos(glm::dot(glm::normalize(cp), glm::vec2(0, -1))) < FoV + angle))
-        {
-            filteredNodes.append(n);
+
+    {
+        Glube::Profiler::Scope scope("find nodes");
+        // meshes stay in the arena while their node is within reach, in view or not
+        Glube::MapNode::List left;
+        grid.recenter(currentMapNode, left);
+        foreach(Glube::MapNode* n, left) {
+            n->deleteBuffers();
+        }
+    }
+    const Glube::MapNode::List &nodes = grid.nodes();
+    const glm::vec3 eye = view[activeCam].getPosition();
+    const glm::mat4 viewProjection = projection * view[0].viewMatrix();
+    Glube::Frustum frustum(viewProjection);
+    {
+        Glube::Profiler::Scope scope("update");
+        // builds are asked for again each frame in the current order of priority;
+        // those of nodes no longer in the grid lapse
+        foreach(Glube::MapNode* n, nodes) {
+            n->update(uploads, eye, frustum);
         }
+        nodeFactory.getBuildQueue().nextFrame();
     }
-    //qDebug() << "Drawing" << filteredNodes.size() << "nodes.";
-    foreach(Glube::MapNode* n, filteredNodes) {
-        n->draw(shaderProg, modelMatrix);
+    {
+        Glube::Profiler::Scope scope("upload");
+        Glube::Profiler::instance().count("pending uploads", uploads.pending());
+        uploads.drain();
+        Glube::Profiler::instance().count("arena used bytes", arena.used() * arena.elementSize());
+        Glube::Profiler::instance().count("arena bytes", arena.capacity() * arena.elementSize());
     }
-    foreach(Glube::MapNode* n, visibleNodes) {
-        if(!filteredNodes.contains(n)) {
-            n->deleteBuffers();
+
+    // the nearest chunks' solid sections are rasterized on the culler's thread meanwhile
+    {
+        Glube::Profiler::Scope scope("occluders");
+        occluderBoxes.clear();
+        foreach(Glube::MapNode* n, nodes) {
+            glm::vec2 d(n->pos().x - view[0].getPosition().x, n->pos().z - view[0].getPosition().z);
+            if(glm::length(d) < OCCLUDER_DISTANCE) n->occluderBoxes(occluderBoxes);
         }
+        occlusion.render(occluderBoxes, viewProjection);
+    }
+
+    // cull every section of the uploaded meshes against the main camera's frustum in one
+    // pass, then drop those no air path reaches (underground, everything outside the
+    // cave the camera is in), then test those left against the occluders
+    std::vector<std::size_t> firstBox;
+    {
+        Glube::Profiler::Scope scope("cull");
+        const bool searched = Glube::MapNode::findVisibleSections(currentMapNode.get(), view[0].getPosition(), frustum,
+                                                                  RenderDistance + ChunkDiag, ++visibilityFrame);
+        sectionBoxes.clear();
+        foreach(Glube::MapNode* n, nodes) {
+            firstBox.push_back(sectionBoxes.size());
+            n->sectionBoxes(sectionBoxes);
+        }
+        frustum.cull(sectionBoxes, sectionVisible);
+        if(searched) {
+            for(int i = 0; i < nodes.size(); ++i) {
+                if(firstBox[i] < sectionVisible.size()) nodes[i]->cullUnvisited(visibilityFrame, &sectionVisible[firstBox[i]]);
+            }
+        }
+        Glube::Profiler::instance().count("occluded sections", occlusion.cull(sectionBoxes, sectionVisible));
+        Glube::Profiler::instance().count("sections", sectionBoxes.size());
+    }
+
+    {
+        Glube::Profiler::Scope scope("draw");
+        // chunk positions come in per draw, so one model matrix serves them all
+        int mLoc = shaderProg.uniformLocation("modelMatrix");
+        glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+        batch.clear();
+        for(int i = 0; i < nodes.size(); ++i) {
+            if(firstBox[i] < sectionVisible.size()) nodes[i]->draw(batch, view[0].getPosition(), &sectionVisible[firstBox[i]]);
+        }
+        Glube::Profiler::instance().count("drawn ranges", batch.size());
+        gpuDraw.begin();
+        renderer.submit(batch, VERTEX_ATTRIB, OFFSET_ATTRIB);
+        gpuDraw.end();
+    }
+    {
+        Glube::Profiler::Scope scope("evict");
+        nodeFactory.evict(nodes, currentMapNode->getX(), currentMapNode->getZ());
+    }
+    Glube::Profiler::instance().count("queued jobs", nodeFactory.getJobPool().pendingJobs());
+    Glube::Profiler::instance().count("queued builds", nodeFactory.getBuildQueue().pending());
+
+    if(showProfile) {
+        if(Glube::Profiler::instance().frame() % PROFILE_REFRESH_FRAMES == 0)
+            overlay.setText(Glube::Profiler::instance().summary(PROFILE_SUMMARY_FRAMES));
+        overlay.draw(in.width, in.height);
+        shaderProg.bind();
     }
-    visibleNodes = nodes;
 }
 
 void Widget::keyPressEvent(QKeyEvent *e)
 {
-    if(!e->isAutoRepeat()) {
-        switch(e->key()) {
-            case Qt::Key_A: motion += glm::vec3(-1, 0, 0); break;
-            case Qt::Key_D: motion += glm::vec3(1, 0, 0); break;
-            case Qt::Key_W:
-                motion += glm::vec3(0, 0, -1); break;
-            case Qt::Key_S: motion += glm::vec3(0, 0, 1); break;
+    bool exportRequested = false;
+    {
+        boost::mutex::scoped_lock lock(inputMutex);
+        if(!e->isAutoRepeat()) {
+            switch(e->key()) {
+                case Qt::Key_A: input.motion += glm::vec3(-1, 0, 0); break;
+                case Qt::Key_D: input.motion += glm::vec3(1, 0, 0); break;
+                case Qt::Key_W:
+                    input.motion += glm::vec3(0, 0, -1); break;
+                case Qt::Key_S: input.motion += glm::vec3(0, 0, 1); break;
+
+                case Qt::Key_Z: input.motion += glm::vec3(0, -1, 0); break;
+                case Qt::Key_X: input.motion += glm::vec3(0, 1, 0); break;
 
-            case Qt::Key_Z: motion += glm::vec3(0, -1, 0); break;
-            case Qt::Key_X: motion += glm::vec3(0, 1, 0); break;
+                case Qt::Key_J: input.yawRate += 1; break;
+                case Qt::Key_L: input.yawRate += -1; break;
 
-            case Qt::Key_J: yawRate += 1; break;
-            case Qt::Key_L: yawRate += -1; break;
+                case Qt::Key_Space: input.jets = true; break;
 
-            case Qt::Key_Space: jets = true; break;
+                case Qt::Key_1: input.activeCam = 0; break;
+                case Qt::Key_2: input.activeCam = 1; break;
+                case Qt::Key_3: input.activeCam = 2; break;
 
-            case Qt::Key_1: activeCam = 0; break;
-            case Qt::Key_2: activeCam = 1; break;
-            case Qt::Key_3: activeCam = 2; break;
+                case Qt::Key_F3: showProfile = !showProfile; break;
+                case Qt::Key_F4: exportRequested = true; break;
 
-            default: QGLWidget::keyPressEvent(e); break;
+                default: QGLWidget::keyPressEvent(e); break;
+            }
+        } else {
+            QGLWidget::keyPressEvent(e);
         }
-    } else {
-        QGLWidget::keyPressEvent(e);
     }
+    // the render thread takes inputMutex every frame, so the files are written without it
+    if(exportRequested) exportProfile();
 }
 
 void Widget::keyReleaseEvent(QKeyEvent *e)
 {
+    boost::mutex::scoped_lock lock(inputMutex);
     if(!e->isAutoRepeat()) {
         switch(e->key()) {
-            case Qt::Key_A: motion += glm::vec3(1, 0, 0); break;
-            case Qt::Key_D: motion += glm::vec3(-1, 0, 0); break;
-            case Qt::Key_W: motion += glm::vec3(0, 0, 1); break;
-            case Qt::Key_S: motion += glm::vec3(0, 0, -1); break;
+            case Qt::Key_A: input.motion += glm::vec3(1, 0, 0); break;
+            case Qt::Key_D: input.motion += glm::vec3(-1, 0, 0); break;
+            case Qt::Key_W: input.motion += glm::vec3(0, 0, 1); break;
+            case Qt::Key_S: input.motion += glm::vec3(0, 0, -1); break;
 
-            case Qt::Key_Z: motion += glm::vec3(0, 1, 0); break;
-            case Qt::Key_X: motion += glm::vec3(0, -1, 0); break;
+            case Qt::Key_Z: input.motion += glm::vec3(0, 1, 0); break;
+            case Qt::Key_X: input.motion += glm::vec3(0, -1, 0); break;
 
-            case Qt::Key_J: yawRate += -1; break;
-            case Qt::Key_L: yawRate += 1; break;
+            case Qt::Key_J: input.yawRate += -1; break;
+            case Qt::Key_L: input.yawRate += 1; break;
 
-            case Qt::Key_Space: jets = false; break;
+            case Qt::Key_Space: input.jets = false; break;
 
             default: QGLWidget::keyReleaseEvent(e); break;
         }
@@ -260,18 +507,36 @@ void Widget::mouseMoveEvent(QMouseEvent *e)
         // only move pointer to centre on first update
         static bool first = true;
         if(!first) {
-            cam[activeCam].setYaw(cam[activeCam].getYaw() - dx * MOUSE_RSPEED);
-            cam[activeCam].setPitch(std::min(MAX_PITCH, std::max(-MAX_PITCH, cam[activeCam].getPitch() - dy * MOUSE_RSPEED)));
+            // the render thread turns the camera at its next frame
+            boost::mutex::scoped_lock lock(inputMutex);
+            input.mouseYaw -= dx * MOUSE_RSPEED;
+            input.mousePitch -= dy * MOUSE_RSPEED;
         } else {
             first = false;
         }
     }
 }
 
+void Widget::exportProfile()
+{
+    // the frames still kept, as a row per frame and as a trace of every scope
+    QDir dir(QDir::home().filePath(PROFILE_DIRECTORY));
+    dir.mkpath(".");
+    const QString base = dir.filePath("profile-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+    Glube::Profiler &profiler = Glube::Profiler::instance();
+    if(profiler.writeCsv(base + ".csv") && profiler.writeTrace(base + ".json")) {
+        qDebug() << "Profile written to" << base + ".csv" << "and" << base + ".json";
+    } else {
+        qDebug() << "Couldn't write the profile to" << base;
+    }
+}
+
 void Widget::LoadShaders()
 {
     shaderProg.addShaderFromSourceFile(QGLShader::Vertex, ":/shaders/vertex.shader");
     shaderProg.addShaderFromSourceFile(QGLShader::Fragment, ":/shaders/fragment.shader");
+    shaderProg.bindAttributeLocation("vertex", VERTEX_ATTRIB);
+    shaderProg.bindAttributeLocation("chunkOffset", OFFSET_ATTRIB);
     shaderProg.link();
     shaderProg.bind();
 }
@@ -7,17 +7,49 @@
 
 #include <QKeyEvent>
 #include <QMouseEvent>
+#include <QShowEvent>
+#include <QResizeEvent>
+#include <QThread>
+#include <QElapsedTimer>
 
 #include "mapnode.h"
-#include "vao.h"
+#include "nodegrid.h"
+#include "glbufferarena.h"
+#include "drawbatch.h"
+#include "batchrenderer.h"
+#include "gluploadqueue.h"
+#include "frustum.h"
+#include "occlusion.h"
+#include "profiler.h"
+#include "gputimer.h"
+#include "overlay.h"
 #include "camera.h"
 
 #include <memory>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
 
 using boost::shared_ptr;
 
+class Widget;
+
+// Runs the widget's render loop. A QThread rather than a boost::thread, since the GL
+// context is handed to it with moveToThread.
+class RenderThread : public QThread
+{
+public:
+    RenderThread(Widget &widget);
+protected:
+    void run();
+private:
+    Widget &widget;
+};
+
+// Everything GL happens on a render thread, which steps the simulation at a fixed
+// UpdatePeriod and draws as often as the display takes frames, with the cameras
+// between the last two steps. The GUI thread only collects input.
 class Widget : public QGLWidget
 {
     Q_OBJECT
@@ -31,27 +63,68 @@ public slots:
 protected:
     void initializeGL();
     void resizeGL(int w, int h);
-    void paintGL();
+    // start the render thread, and keep the GUI thread off the context
+    void showEvent(QShowEvent *e);
+    void paintEvent(QPaintEvent *e);
+    void resizeEvent(QResizeEvent *e);
 
     void keyPressEvent(QKeyEvent *e);
     void keyReleaseEvent(QKeyEvent *e);
     void mouseMoveEvent(QMouseEvent *e);
 
 private:
+    friend class RenderThread;
+
+    // what the GUI thread hands the render thread, under inputMutex
+    struct Input {
+        glm::vec3 motion;
+        float yawRate;
+        bool jets;
+        int activeCam;
+        float mouseYaw, mousePitch;  // turned since the last frame
+        int width, height;
+        bool resized;
+    };
+
     void LoadShaders();
+    void exportProfile();
+    void renderLoop();
+    void simulate(const Input &in);
+    // draws alpha of the way from the previous simulation step to the last
+    void renderFrame(const Input &in, float alpha);
 
-    QGLShaderProgram shaderProg;
-    Glube::VAO vao;
-    glm::vec3 motion;
-    float yawRate;
-    bool jets;
-    int activeCam;
+    boost::mutex inputMutex;
+    Input input;
+    RenderThread renderThread;
+    boost::atomic<bool> rendering;
 
+    QGLShaderProgram shaderProg;
+    // the simulated cameras, their state a step before and the cameras drawn
     Glube::Camera cam[3];
+    glm::vec3 previousPosition[3];
+    float previousYaw[3];
+    Glube::Camera view[3];
+    unsigned long steps;
+    glm::mat4 projection;
 
+    // chunk meshes live in the arena, which outlives the nodes
+    Glube::GLBufferArena arena;
+    Glube::GLUploadQueue uploads;
+    Glube::DrawBatch batch;
+    Glube::BatchRenderer renderer;
     Glube::MapNodeFactory nodeFactory;
     shared_ptr<Glube::MapNode> currentMapNode;
-    Glube::MapNode::List visibleNodes;
+    // the nodes around currentMapNode that are updated and drawn
+    Glube::NodeGrid grid;
+    // section bounds and their culling results, kept between frames to reuse the space
+    Glube::BoxList sectionBoxes, occluderBoxes;
+    std::vector<unsigned char> sectionVisible;
+    Glube::OcclusionCuller occlusion;
+    unsigned visibilityFrame;
+    // F3 shows the profiler's numbers, F4 exports its frames
+    Glube::GpuTimer gpuDraw;
+    Glube::Overlay overlay;
+    boost::atomic<bool> showProfile;
 };
 
 #endif // WIDGET_H